@@ -66,6 +66,12 @@
 
 PICOGK_API void         Library_Init(                       float fVoxelSizeMM);
 
+PICOGK_API void         Library_SetRenormalizeAfterRender(  bool bRenormalize);
+
+PICOGK_API void         Library_SetAutoCompact(             bool bAutoCompact);
+
+PICOGK_API int64_t      Library_nAutoCompactedBytes();
+
 PICOGK_API void         Library_GetName(                    char psz[PKINFOSTRINGLEN]);
 
 PICOGK_API void         Library_GetVersion(                 char psz[PKINFOSTRINGLEN]);
@@ -95,6 +101,9 @@ PICOGK_API PKMESH           Mesh_hCreate();
 
 PICOGK_API PKMESH           Mesh_hCreateFromVoxels(         PKVOXELS            hVoxels);
 
+PICOGK_API PKMESH           Mesh_hCreateFromVoxelsAdaptive( PKVOXELS            hVoxels,
+                                                            float               fAdaptivity);
+
 PICOGK_API bool             Mesh_bIsValid(                  PKMESH              hThis);
 
 PICOGK_API void             Mesh_Destroy(                   PKMESH              hThis);
@@ -102,6 +111,10 @@ PICOGK_API void             Mesh_Destroy(                   PKMESH
 PICOGK_API int32_t          Mesh_nAddVertex(                PKMESH              hThis,
                                                             const PKVector3*    pvecVertex);
 
+PICOGK_API int32_t          Mesh_nAddVertices(              PKMESH              hThis,
+                                                            const PKVector3*    pvecVertices,
+                                                            int32_t             nCount);
+
 PICOGK_API int32_t          Mesh_nVertexCount(              PKMESH              hThis);
 
 PICOGK_API void             Mesh_GetVertex(                 PKMESH              hThis,
@@ -111,6 +124,14 @@ PICOGK_API void             Mesh_GetVertex(                 PKMESH
 PICOGK_API int32_t          Mesh_nAddTriangle(              PKMESH hThis,
                                                             const PKTriangle*   psTri);
 
+PICOGK_API int32_t          Mesh_nAddTriangles(             PKMESH              hThis,
+                                                            const PKTriangle*   psTriangles,
+                                                            int32_t             nCount);
+
+PICOGK_API void             Mesh_Reserve(                   PKMESH              hThis,
+                                                            int32_t             nVertices,
+                                                            int32_t             nTriangles);
+
 PICOGK_API int32_t          Mesh_nTriangleCount(            PKMESH              hThis);
 
 PICOGK_API void             Mesh_GetTriangle(               PKMESH              hThis,
@@ -123,9 +144,71 @@ PICOGK_API void             Mesh_GetTriangleV(              PKMESH
                                                             PKVector3*          pvecB,
                                                             PKVector3*          pvecC);
 
+// Ranges reaching outside the mesh are clipped, only the
+// existing elements are copied
+
+PICOGK_API void             Mesh_GetVertices(               PKMESH              hThis,
+                                                            int32_t             nStart,
+                                                            int32_t             nCount,
+                                                            PKVector3*          pvecVertices);
+
+PICOGK_API void             Mesh_GetTriangles(              PKMESH              hThis,
+                                                            int32_t             nStart,
+                                                            int32_t             nCount,
+                                                            PKTriangle*         psTriangles);
+
+// The returned pointers stay valid until the mesh is modified or destroyed
+
+PICOGK_API const PKVector3* Mesh_pVertexData(               PKMESH              hThis);
+
+PICOGK_API const PKTriangle* Mesh_pTriangleData(            PKMESH              hThis);
+
 PICOGK_API void             Mesh_GetBoundingBox(            PKMESH              hThis,
                                                             PKBBox3*            poBox);
 
+PICOGK_API int32_t          Mesh_nDecimate(                 PKMESH              hThis,
+                                                            int32_t             nTargetTriangles,
+                                                            float               fMaxDeviationMM);
+
+// Spatial queries, accelerated by a bounding volume hierarchy that is built
+// on first use. Output arrays passed as nullptr are skipped. Signed distances
+// and inside tests require a closed mesh
+
+PICOGK_API bool             Mesh_bClosestPoint(             PKMESH              hThis,
+                                                            const PKVector3*    pvecPoint,
+                                                            PKVector3*          pvecClosest,
+                                                            int32_t*            pnTriangle,
+                                                            float*              pfDistance);
+
+PICOGK_API void             Mesh_ClosestPoints(             PKMESH              hThis,
+                                                            int32_t             nPoints,
+                                                            const PKVector3*    pvecPoints,
+                                                            PKVector3*          pvecClosest,
+                                                            int32_t*            pnTriangles,
+                                                            float*              pfDistances);
+
+PICOGK_API void             Mesh_RayCastBatch(              PKMESH              hThis,
+                                                            int32_t             nRays,
+                                                            const PKVector3*    pvecOrigins,
+                                                            const PKVector3*    pvecDirections,
+                                                            bool*               pbHits,
+                                                            PKVector3*          pvecHits,
+                                                            int32_t*            pnTriangles,
+                                                            float*              pfDistances);
+
+// Normal of the triangle nearest to each point, the points
+// don't have to lie on the surface
+
+PICOGK_API void             Mesh_GetNearestSurfaceNormals(  PKMESH              hThis,
+                                                            int32_t             nPoints,
+                                                            const PKVector3*    pvecPoints,
+                                                            PKVector3*          pvecNormals);
+
+PICOGK_API void             Mesh_SignedDistances(           PKMESH              hThis,
+                                                            int32_t             nPoints,
+                                                            const PKVector3*    pvecPoints,
+                                                            float*              pfDistances);
+
 // LATTICE
 
 PICOGK_API PKLATTICE        Lattice_hCreate();
@@ -149,6 +232,25 @@ PICOGK_API void             Lattice_AddBeam(                PKLATTICE
                                                             float               fRadiusB,
                                                             bool                bRoundCap);
 
+PICOGK_API void             Lattice_AddSpheres(             PKLATTICE           hThis,
+                                                            const PKVector3*    pvecCenters,
+                                                            const float*        pfRadii,
+                                                            int32_t             nCount);
+
+// pbRoundCap can be nullptr, in which case all beams get round caps
+PICOGK_API void             Lattice_AddBeams(               PKLATTICE           hThis,
+                                                            const PKVector3*    pvecA,
+                                                            const PKVector3*    pvecB,
+                                                            const float*        pfRadiusA,
+                                                            const float*        pfRadiusB,
+                                                            const bool*         pbRoundCap,
+                                                            int32_t             nCount);
+
+PICOGK_API void             Lattice_Reserve(                PKLATTICE           hThis,
+                                                            int32_t             nSpheres,
+                                                            int32_t             nRoundCapBeams,
+                                                            int32_t             nFlatCapBeams);
+
 // VOXELS
 
 PICOGK_API PKVOXELS         Voxels_hCreate();
@@ -168,6 +270,28 @@ PICOGK_API void             Voxels_BoolSubtract(            PKVOXELS
 PICOGK_API void             Voxels_BoolIntersect(           PKVOXELS            hThis,
                                                             PKVOXELS            hOther);
 
+// Union of all operands, added to / subtracted from hThis in one call
+PICOGK_API void             Voxels_BoolAddMany(             PKVOXELS            hThis,
+                                                            const PKVOXELS*     phOperands,
+                                                            int32_t             nCount);
+
+PICOGK_API void             Voxels_BoolSubtractMany(        PKVOXELS            hThis,
+                                                            const PKVOXELS*     phOperands,
+                                                            int32_t             nCount);
+
+// The consuming booleans take over the voxels of hOther, instead of
+// copying them, and leave hOther empty. Use them when hOther isn't
+// needed afterwards, it stays valid and still has to be destroyed
+
+PICOGK_API void             Voxels_BoolAddConsume(          PKVOXELS            hThis,
+                                                            PKVOXELS            hOther);
+
+PICOGK_API void             Voxels_BoolSubtractConsume(     PKVOXELS            hThis,
+                                                            PKVOXELS            hOther);
+
+PICOGK_API void             Voxels_BoolIntersectConsume(    PKVOXELS            hThis,
+                                                            PKVOXELS            hOther);
+
 PICOGK_API void             Voxels_Offset(                  PKVOXELS            hThis,
                                                             float               fDist);
 
@@ -178,6 +302,14 @@ PICOGK_API void             Voxels_DoubleOffset(            PKVOXELS
 PICOGK_API void             Voxels_TripleOffset(            PKVOXELS            hThis,
                                                             float               fDist);
 
+#define PKSMOOTH_OPEN       0   // removes features thinner than 2x fDist
+#define PKSMOOTH_CLOSE      1   // fills gaps and concave corners
+#define PKSMOOTH_OPENCLOSE  2   // both, same as Voxels_TripleOffset
+
+PICOGK_API void             Voxels_Smoothen(                PKVOXELS            hThis,
+                                                            float               fDist,
+                                                            int32_t             eMode);
+
 PICOGK_API void             Voxels_Gaussian(                PKVOXELS            hThis,
                                                             float               fDist);
 
@@ -187,13 +319,53 @@ PICOGK_API void             Voxels_Median(                  PKVOXELS
 PICOGK_API void             Voxels_Mean(                    PKVOXELS            hThis,
                                                             float               fDist);
 
+#define PKFILTER_OFFSET     0
+#define PKFILTER_GAUSSIAN   1
+#define PKFILTER_MEDIAN     2
+#define PKFILTER_MEAN       3
+
+PICOGK_API void             Voxels_FilterInBBox(            PKVOXELS            hThis,
+                                                            int32_t             eFilter,
+                                                            float               fDist,
+                                                            const PKBBox3*      poBBox);
+
+PICOGK_API void             Voxels_FilterMasked(            PKVOXELS            hThis,
+                                                            int32_t             eFilter,
+                                                            float               fDist,
+                                                            PKVOXELS            hMask);
+
+PICOGK_API void             Voxels_FilterScalarMasked(      PKVOXELS            hThis,
+                                                            int32_t             eFilter,
+                                                            float               fDist,
+                                                            PKSCALARFIELD       hMask);
+
 PICOGK_API void             Voxels_RenderMesh(              PKVOXELS            hThis,
                                                             PKMESH              hMesh);
 
+// Renders the exact signed distance to a closed mesh
+
+PICOGK_API void             Voxels_RenderMeshImplicit(      PKVOXELS            hThis,
+                                                            PKMESH              hMesh);
+
 PICOGK_API void             Voxels_RenderImplicit(          PKVOXELS            hThis,
                                                             const PKBBox3*      poBBox,
                                                             PKPFnfSdf           pfnSDF);
 
+// The SDF callback is called concurrently from multiple threads
+// and must be thread-safe
+
+PICOGK_API void             Voxels_RenderImplicitParallel(  PKVOXELS            hThis,
+                                                            const PKBBox3*      poBBox,
+                                                            PKPFnfSdf           pfnSDF);
+
+// Only evaluates the SDF near the surface, fLipschitz is the maximum
+// rate of change of the SDF (1 for an exact signed distance function)
+
+PICOGK_API void             Voxels_RenderImplicitNarrowBand(PKVOXELS            hThis,
+                                                            const PKBBox3*      poBBox,
+                                                            PKPFnfSdf           pfnSDF,
+                                                            float               fLipschitz);
+
 PICOGK_API void             Voxels_IntersectImplicit(       PKVOXELS            hThis,
                                                             PKPFnfSdf           pfnSDF);
 
@@ -207,13 +379,40 @@ PICOGK_API void             Voxels_ProjectZSlice(           PKVOXELS
 PICOGK_API bool             Voxels_bIsInside(               PKVOXELS            hThis,
                                                             const PKVector3*    pvecTestPoint);
 
+// Queries nPoints positions at once, returning the inside flags, the
+// signed distance in mm and the surface normal (normalized gradient),
+// all interpolated. Pass nullptr for any result you don't need
+PICOGK_API void             Voxels_QueryPoints(             PKVOXELS            hThis,
+                                                            int32_t             nPoints,
+                                                            const PKVector3*    pvecPoints,
+                                                            bool*               pbInside,
+                                                            float*              pfSdValues,
+                                                            PKVector3*          pvecNormals);
+
 PICOGK_API bool             Voxels_bIsEqual(                PKVOXELS            hThis,
                                                             PKVOXELS            hOther);
 
+// Equal if the signed distances differ by no more than fToleranceMM
+// everywhere, a tolerance of 0 compares inside/outside, like bIsEqual
+PICOGK_API bool             Voxels_bIsEqualWithin(          PKVOXELS            hThis,
+                                                            PKVOXELS            hOther,
+                                                            float               fToleranceMM);
+
 PICOGK_API void             Voxels_CalculateProperties(     PKVOXELS            hThis,
                                                             float*              pfVolume,
                                                             PKBBox3*            poBBox);
 
+// Volume, surface area, centroid and inertia tensor in one pass,
+// inertia is about the centroid for a density of 1, the off-diagonal
+// terms are (Ixy, Ixz, Iyz)
+PICOGK_API void             Voxels_CalculateMassProperties( PKVOXELS            hThis,
+                                                            float*              pfVolume,
+                                                            float*              pfSurfaceArea,
+                                                            PKVector3*          pvecCentroid,
+                                                            PKVector3*          pvecInertiaDiag,
+                                                            PKVector3*          pvecInertiaOffDiag,
+                                                            PKBBox3*            poBBox);
+
 PICOGK_API void             Voxels_GetSurfaceNormal(        PKVOXELS            hThis,
                                                             const PKVector3*    pvecSurfacePoint,
                                                             PKVector3*          pvecNormal);
@@ -227,6 +426,22 @@ PICOGK_API bool             Voxels_bRayCastToSurface(       PKVOXELS
                                                             const PKVector3*    pvecDirection,
                                                             PKVector3*          pvecSurfacePoint);
 
+// Casts nRays rays in parallel, returning up to nMaxHitsPerRay surface
+// crossings per ray (entering and exiting the object in turn), pass 1
+// to get the first hit only. pnHitCounts has nRays entries, pvecHits,
+// pvecNormals and pfDistances have nRays * nMaxHitsPerRay entries, hit
+// n of ray r is at r * nMaxHitsPerRay + n. pvecNormals and pfDistances
+// can be nullptr
+PICOGK_API void             Voxels_RayCastBatch(            PKVOXELS            hThis,
+                                                            int32_t             nRays,
+                                                            const PKVector3*    pvecOrigins,
+                                                            const PKVector3*    pvecDirections,
+                                                            int32_t             nMaxHitsPerRay,
+                                                            int32_t*            pnHitCounts,
+                                                            PKVector3*          pvecHits,
+                                                            PKVector3*          pvecNormals,
+                                                            float*              pfDistances);
+
 PICOGK_API void             Voxels_GetVoxelDimensions(      PKVOXELS            hThis,
                                                             int32_t*            pnXOrigin,
                                                             int32_t*            pnYOrigin,
@@ -235,6 +450,16 @@ PICOGK_API void             Voxels_GetVoxelDimensions(      PKVOXELS
                                                             int32_t*            pnYSize,
                                                             int32_t*            pnZSize);
 
+PICOGK_API void             Voxels_Renormalize(             PKVOXELS            hThis);
+
+PICOGK_API int64_t          Voxels_nCompact(                PKVOXELS            hThis,
+                                                            bool                bSignedFloodFill);
+
+PICOGK_API void             Voxels_GetGridStatistics(       PKVOXELS            hThis,
+                                                            int64_t*            pnActiveVoxels,
+                                                            int64_t*            pnLeafNodes,
+                                                            int64_t*            pnMemoryBytes);
+
 PICOGK_API void             Voxels_GetSlice(                PKVOXELS            hThis,
                                                             int32_t             nZSlice,
                                                             float*              pfBuffer,
@@ -20,6 +20,8 @@
 #include <iostream>
 #include "PicoGKStlLoader.h"
 #include <thread>
+#include <cmath>
+#include <algorithm>
 #include <assert.h>
 
 // Change this to run tests
@@ -180,6 +182,93 @@ void MouseButton(   PKVIEWER    hViewer,
 }
 
 
+float fSdfSlab(const PKVector3* pvec)
+{
+    // Box of 40 x 40 x 10 mm around the origin
+    float fX = std::abs(pvec->X) - 20.0f;
+    float fY = std::abs(pvec->Y) - 20.0f;
+    float fZ = std::abs(pvec->Z) - 5.0f;
+    
+    float fOutside = std::sqrt( std::max(fX, 0.0f) * std::max(fX, 0.0f) +
+                                std::max(fY, 0.0f) * std::max(fY, 0.0f) +
+                                std::max(fZ, 0.0f) * std::max(fZ, 0.0f));
+    
+    return fOutside + std::min(std::max(fX, std::max(fY, fZ)), 0.0f);
+}
+
+bool bTestRayCastSlab()
+{
+    // Casts straight and slanted rays through a 10mm slab, every ray
+    // has to enter and exit exactly once, at the expected distances
+    
+    PKVOXELS hSlab = Voxels_hCreate();
+    
+    PKBBox3 oBBox;
+    oBBox.vecMin = {-21.0f, -21.0f, -6.0f};
+    oBBox.vecMax = { 21.0f,  21.0f,  6.0f};
+    
+    Voxels_RenderImplicit(hSlab, &oBBox, fSdfSlab);
+    
+    std::vector<PKVector3> oOrigins;
+    std::vector<PKVector3> oDirections;
+    
+    for (int x=0; x<8; x++)
+    for (int y=0; y<8; y++)
+    {
+        // fractional positions, so rays don't run along voxel centers
+        PKVector3 vecOrigin = {-8.0f + x * 1.13f, -8.0f + y * 0.97f, -30.0f};
+        
+        oOrigins.push_back(vecOrigin);
+        oDirections.push_back({0.0f, 0.0f, 1.0f});
+        
+        oOrigins.push_back(vecOrigin);
+        oDirections.push_back({0.3f, 0.2f, 1.0f});
+    }
+    
+    const int32_t nMaxHits = 4;
+    int32_t nRays = (int32_t) oOrigins.size();
+    
+    std::vector<int32_t>    anHitCounts(nRays);
+    std::vector<PKVector3>  avecHits(nRays * nMaxHits);
+    std::vector<float>      afDistances(nRays * nMaxHits);
+    
+    Voxels_RayCastBatch(    hSlab,
+                            nRays,
+                            oOrigins.data(),
+                            oDirections.data(),
+                            nMaxHits,
+                            anHitCounts.data(),
+                            avecHits.data(),
+                            nullptr,
+                            afDistances.data());
+    
+    Voxels_Destroy(hSlab);
+    
+    bool bOk = true;
+    
+    for (int32_t n=0; n<nRays; n++)
+    {
+        const PKVector3& vecDir = oDirections[n];
+        float fCos = vecDir.Z / std::sqrt(vecDir.X * vecDir.X + vecDir.Y * vecDir.Y + vecDir.Z * vecDir.Z);
+        
+        // from z=-30 to the faces at z=-5 and z=+5
+        float fEntry    = 25.0f / fCos;
+        float fExit     = 35.0f / fCos;
+        
+        if (    (anHitCounts[n] != 2) ||
+                (std::abs(afDistances[n * nMaxHits]     - fEntry) > 0.1f) ||
+                (std::abs(afDistances[n * nMaxHits + 1] - fExit)  > 0.1f))
+        {
+            std::cout   << "Ray cast through slab failed for ray " << n << ": "
+                        << anHitCounts[n] << " hits, expected entry " << fEntry
+                        << "mm and exit " << fExit << "mm\n";
+            bOk = false;
+        }
+    }
+    
+    return bOk;
+}
+
 int main(int argc, const char * argv[])
 {
     char pszInfo[PKINFOSTRINGLEN];
@@ -195,6 +284,9 @@ int main(int argc, const char * argv[])
     Library_GetBuildInfo(pszInfo);
     std::cout << pszInfo << "\n";
     
+    if (!bTestRayCastSlab())
+        return 97;
+    
     PKMESH hMesh = Mesh_hCreate();
     assert(Mesh_bIsValid(hMesh));
     
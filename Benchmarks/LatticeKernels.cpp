@@ -0,0 +1,154 @@
+//
+// SPDX-License-Identifier: CC0-1.0
+//
+// This example code file is released to the public under Creative Commons CC0.
+// See https://creativecommons.org/publicdomain/zero/1.0/legalcode
+//
+// To the extent possible under law, LEAP 71 has waived all copyright and
+// related or neighboring rights to this PicoGK Example Code.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "../Source/PicoGKLattice.h"
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <cmath>
+
+double dRenderLatticeRows(  const PicoGK::Lattice& oLattice,
+                            const PicoGK::LatticeSimd::Kernels& oKernels,
+                            int nRepeat,
+                            std::vector<float>* pafValues)
+{
+    // Evaluates every primitive over an 8x8x8 leaf around its start point,
+    // the same way Voxels::RenderLattice does, and returns the time in ms
+    
+    using namespace PicoGK;
+    
+    const int nRow  = LatticeSimd::nRowSize;
+    float fStep     = 0.25f;
+    
+    const LatticeSpheres&       oSpheres    = oLattice.oSpheres();
+    const LatticeRoundCones&    oRoundCones = oLattice.oRoundCones();
+    const LatticeFlatCones&     oFlatCones  = oLattice.oFlatCones();
+    
+    size_t nPrimitives = oSpheres.nCount() + oRoundCones.nCount() + oFlatCones.nCount();
+    pafValues->assign(nPrimitives * nRow * nRow * nRow, 0.0f);
+    
+    auto oStart = std::chrono::steady_clock::now();
+    
+    for (int nPass=0; nPass<nRepeat; nPass++)
+    {
+        float* pfValues = pafValues->data();
+        
+        auto RenderLeaf = [&](  const auto& oConsts,
+                                auto pfnRow,
+                                float fX0,
+                                float fY0,
+                                float fZ0)
+        {
+            for (int x=0; x<nRow; x++)
+            for (int y=0; y<nRow; y++)
+            {
+                pfnRow(oConsts, fX0 + x * fStep, fY0 + y * fStep, fZ0, fStep, pfValues);
+                pfValues += nRow;
+            }
+        };
+        
+        for (size_t n=0; n<oSpheres.nCount(); n++)
+        {
+            LatticeSphereConsts o = oSpheres.oConsts(n);
+            RenderLeaf(o, oKernels.pfnSphereRow, o.fCX - 1.0f, o.fCY - 1.0f, o.fCZ - 1.0f);
+        }
+        
+        for (size_t n=0; n<oRoundCones.nCount(); n++)
+        {
+            LatticeRoundConeConsts o = oRoundCones.oConsts(n);
+            RenderLeaf(o, oKernels.pfnRoundConeRow, o.fAX - 1.0f, o.fAY - 1.0f, o.fAZ - 1.0f);
+        }
+        
+        for (size_t n=0; n<oFlatCones.nCount(); n++)
+        {
+            LatticeFlatConeConsts o = oFlatCones.oConsts(n);
+            RenderLeaf(o, oKernels.pfnFlatConeRow, o.fAX - 1.0f, o.fAY - 1.0f, o.fAZ - 1.0f);
+        }
+    }
+    
+    std::chrono::duration<double, std::milli> oTime = std::chrono::steady_clock::now() - oStart;
+    return oTime.count();
+}
+
+bool bTestLatticeKernels()
+{
+    // Renders the same random lattice through the portable and the
+    // runtime selected (AVX2) kernels, compares the results and the time
+    
+    using namespace PicoGK;
+    
+    std::mt19937 oRandom(71);
+    std::uniform_real_distribution<float> oPos(-50.0f, 50.0f);
+    std::uniform_real_distribution<float> oRad(0.5f, 5.0f);
+    
+    Lattice oLattice;
+    
+    for (int n=0; n<20000; n++)
+    {
+        Vector3 vecS(oPos(oRandom), oPos(oRandom), oPos(oRandom));
+        Vector3 vecE(oPos(oRandom), oPos(oRandom), oPos(oRandom));
+        
+        oLattice.AddBeam(vecS, vecE, oRad(oRandom), oRad(oRandom), (n % 2) == 0);
+        
+        if ((n % 4) == 0)
+            oLattice.AddSphere(vecS, oRad(oRandom));
+    }
+    
+    const LatticeSimd::Kernels& oSelected = LatticeSimd::oKernels();
+    const LatticeSimd::Kernels& oPortable = LatticeSimd::oPortableKernels();
+    
+    if (oSelected.pfnRoundConeRow == oPortable.pfnRoundConeRow)
+    {
+        std::cout << "Lattice kernels: AVX2 not available, only the portable kernels are used\n";
+        return true;
+    }
+    
+    const int nRepeat = 10;
+    
+    std::vector<float> afPortable;
+    std::vector<float> afSimd;
+    
+    // warm up, so both runs start with the same cache state
+    dRenderLatticeRows(oLattice, oPortable, 1, &afPortable);
+    dRenderLatticeRows(oLattice, oSelected, 1, &afSimd);
+    
+    double dPortableMs  = dRenderLatticeRows(oLattice, oPortable, nRepeat, &afPortable);
+    double dSimdMs      = dRenderLatticeRows(oLattice, oSelected, nRepeat, &afSimd);
+    
+    float fMaxDiff = 0.0f;
+    for (size_t n=0; n<afPortable.size(); n++)
+        fMaxDiff = std::max(fMaxDiff, std::abs(afPortable[n] - afSimd[n]));
+    
+    std::cout   << "Lattice kernels: portable " << dPortableMs << "ms, AVX2 " << dSimdMs << "ms, "
+                << "speedup " << dPortableMs / dSimdMs << "x, "
+                << "max difference " << fMaxDiff << "mm\n";
+    
+    // FMA contraction changes the rounding slightly, nothing more
+    return fMaxDiff < 1e-3f;
+}
+
+int main(int argc, const char * argv[])
+{
+    if (!bTestLatticeKernels())
+    {
+        std::cout << "Lattice kernels: SIMD and portable results differ\n";
+        return 1;
+    }
+    
+    return 0;
+}
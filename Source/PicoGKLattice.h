@@ -37,154 +37,234 @@
 #define PICOGKLATTICE_H_
 
 #include "PicoGKTypes.h"
+#include "PicoGKLatticeSimd.h"
 #include <memory>
 #include <algorithm>
 #include <vector>
+#include <initializer_list>
 
 namespace PicoGK
 {
 
-class LatticeSphere
+// The primitives are stored as structures of arrays, holding only the
+// shape-dependent terms of their signed distance functions, which are
+// computed once when the primitive is added. Round-cap and flat-cap
+// beams are kept apart, so the kernels don't have to branch
+
+class LatticeSpheres
 {
 public:
-    PKSHAREDPTR(LatticeSphere);
-    
-    LatticeSphere(  const Vector3& vecCenter,
-                    float fRadius)
-    : m_vecC(vecCenter)
+    void Add(   const Vector3& vecCenter,
+                float fRadius)
     {
-        m_fRad = fRadius;
-        
-        m_oBBox.Include(m_vecC);
-        m_oBBox.Grow(m_fRad);
+        m_afCX.push_back(vecCenter.X);
+        m_afCY.push_back(vecCenter.Y);
+        m_afCZ.push_back(vecCenter.Z);
+        m_afR.push_back(fRadius);
     }
     
-    inline float fSdValue(const Vector3& vecSample) const
+    void Reserve(size_t nCount)
     {
-        return (vecSample - m_vecC).fLength() - m_fRad;
+        m_afCX.reserve(nCount);
+        m_afCY.reserve(nCount);
+        m_afCZ.reserve(nCount);
+        m_afR.reserve(nCount);
     }
     
-    inline Vector3 vecMin() const           {return m_oBBox.vecMin;}
+    inline size_t nCount() const    {return m_afR.size();}
     
-    inline Vector3 vecMax() const           {return m_oBBox.vecMax;}
+    inline LatticeSphereConsts oConsts(size_t n) const
+    {
+        LatticeSphereConsts o;
+        o.fCX   = m_afCX[n];
+        o.fCY   = m_afCY[n];
+        o.fCZ   = m_afCZ[n];
+        o.fR    = m_afR[n];
+        return o;
+    }
     
-    inline const BBox3& oBBox() const       {return m_oBBox;}
+    BBox3 oBBox(size_t n) const
+    {
+        BBox3 oBBox;
+        oBBox.Include(Vector3(m_afCX[n], m_afCY[n], m_afCZ[n]));
+        oBBox.Grow(m_afR[n]);
+        return oBBox;
+    }
     
 protected:
-    
-    Vector3 m_vecC;
-    float   m_fRad;
-    BBox3   m_oBBox;
+    std::vector<float> m_afCX;
+    std::vector<float> m_afCY;
+    std::vector<float> m_afCZ;
+    std::vector<float> m_afR;
 };
 
-
-class LatticeBeam
+class LatticeRoundCones
 {
 public:
-    PKSHAREDPTR(LatticeBeam);
-    
-    LatticeBeam(    const Vector3& vecA,
-                    const Vector3& vecB,
-                    float fRadiusA,
-                    float fRadiusB,
-                    bool bRoundCap)
-    :   m_vecS(vecA),
-        m_vecE(vecB),
-        m_fRadS(fRadiusA),
-        m_fRadE(fRadiusB),
-        m_bRoundCap(bRoundCap)
+    void Add(   const Vector3& vecS,
+                const Vector3& vecE,
+                float fRadS,
+                float fRadE)
     {
-        m_oBBox.Include(m_vecS);
-        m_oBBox.Include(m_vecE);
-        m_oBBox.Grow(std::max<float>(m_fRadS, m_fRadE));
+        Vector3 ba  = vecE - vecS;
+        float l2    = ba.fDot(ba);
+        float rr    = fRadS - fRadE;
+        
+        m_afAX.push_back(vecS.X);
+        m_afAY.push_back(vecS.Y);
+        m_afAZ.push_back(vecS.Z);
+        m_afBAX.push_back(ba.X);
+        m_afBAY.push_back(ba.Y);
+        m_afBAZ.push_back(ba.Z);
+        m_afL2.push_back(l2);
+        m_afIL2.push_back(1.0f / l2);
+        m_afRR.push_back(rr);
+        m_afA2.push_back(l2 - rr * rr);
+        m_afKRR.push_back(Math::iSign(rr) * rr * rr);
+        m_afR1.push_back(fRadS);
+        m_afR2.push_back(fRadE);
     }
     
-    inline float fSdValue(const Vector3& vecSample) const
+    void Reserve(size_t nCount)
     {
-        if (m_bRoundCap)
-            return fSdvRoundCone(vecSample);
-        
-        return fSdvFlatCone(vecSample);
+        for (std::vector<float>* poArray : { &m_afAX, &m_afAY, &m_afAZ,
+                                             &m_afBAX, &m_afBAY, &m_afBAZ,
+                                             &m_afL2, &m_afIL2, &m_afRR,
+                                             &m_afA2, &m_afKRR, &m_afR1, &m_afR2})
+        {
+            poArray->reserve(nCount);
+        }
     }
     
-    inline Vector3 vecMin() const           {return m_oBBox.vecMin;}
+    inline size_t nCount() const    {return m_afR1.size();}
     
-    inline Vector3 vecMax() const           {return m_oBBox.vecMax;}
+    inline LatticeRoundConeConsts oConsts(size_t n) const
+    {
+        LatticeRoundConeConsts o;
+        o.fAX   = m_afAX[n];
+        o.fAY   = m_afAY[n];
+        o.fAZ   = m_afAZ[n];
+        o.fBAX  = m_afBAX[n];
+        o.fBAY  = m_afBAY[n];
+        o.fBAZ  = m_afBAZ[n];
+        o.fL2   = m_afL2[n];
+        o.fIL2  = m_afIL2[n];
+        o.fRR   = m_afRR[n];
+        o.fA2   = m_afA2[n];
+        o.fKRR  = m_afKRR[n];
+        o.fR1   = m_afR1[n];
+        o.fR2   = m_afR2[n];
+        return o;
+    }
     
-    inline const BBox3& oBBox() const       {return m_oBBox;}
+    BBox3 oBBox(size_t n) const
+    {
+        Vector3 vecS(m_afAX[n], m_afAY[n], m_afAZ[n]);
+        
+        BBox3 oBBox;
+        oBBox.Include(vecS);
+        oBBox.Include(vecS + Vector3(m_afBAX[n], m_afBAY[n], m_afBAZ[n]));
+        oBBox.Grow(std::max(m_afR1[n], m_afR2[n]));
+        return oBBox;
+    }
     
 protected:
-    
-    float fSdvRoundCone(const Vector3& p) const
+    std::vector<float> m_afAX;
+    std::vector<float> m_afAY;
+    std::vector<float> m_afAZ;
+    std::vector<float> m_afBAX;
+    std::vector<float> m_afBAY;
+    std::vector<float> m_afBAZ;
+    std::vector<float> m_afL2;
+    std::vector<float> m_afIL2;
+    std::vector<float> m_afRR;
+    std::vector<float> m_afA2;
+    std::vector<float> m_afKRR;
+    std::vector<float> m_afR1;
+    std::vector<float> m_afR2;
+};
+
+class LatticeFlatCones
+{
+public:
+    void Add(   const Vector3& vecS,
+                const Vector3& vecE,
+                float fRadS,
+                float fRadE)
     {
-        Vector3 b = m_vecE;
-        Vector3 a = m_vecS;
-        float r1 = m_fRadS;
-        float r2 = m_fRadE;
-        
-        // sampling independent computations (only depend on shape)
-        Vector3 ba = b - a;
-        float l2 = ba.fDot(ba);
-        float rr = r1 - r2;
-        float a2 = l2 - rr * rr;
-        float il2 = 1.0f / l2;
+        Vector3 ba  = vecE - vecS;
+        float baba  = ba.fDot(ba);
+        float rba   = fRadE - fRadS;
         
-        // sampling dependant computations
-        Vector3 pa = p - a;
-        float y = pa.fDot(ba);
-        float z = y - l2;
-        float x2 = (pa * l2 - ba * y).fDot((pa * l2 - ba * y));
-        float y2 = y * y * l2;
-        float z2 = z * z * l2;
-        
-        // single square root!
-        float k = Math::iSign(rr) * rr * rr * x2;
-        
-        if (Math::iSign(z) * a2 * z2 > k)
-            return sqrtf(x2 + z2) * il2 - r2;
-        
-        if (Math::iSign(y) * a2 * y2 < k)
-            return sqrtf(x2 + y2) * il2 - r1;
-        
-        return (sqrtf(x2 * a2 * il2) + y * rr) * il2 - r1;
+        m_afAX.push_back(vecS.X);
+        m_afAY.push_back(vecS.Y);
+        m_afAZ.push_back(vecS.Z);
+        m_afBAX.push_back(ba.X);
+        m_afBAY.push_back(ba.Y);
+        m_afBAZ.push_back(ba.Z);
+        m_afBABA.push_back(baba);
+        m_afIBABA.push_back(1.0f / baba);
+        m_afRA.push_back(fRadS);
+        m_afRB.push_back(fRadE);
+        m_afRBA.push_back(rba);
+        m_afIK.push_back(1.0f / (rba * rba + baba));
     }
     
-    float fSdvFlatCone(const Vector3& p) const
+    void Reserve(size_t nCount)
     {
-        Vector3 b = m_vecE;
-        Vector3 a = m_vecS;
-        float ra = m_fRadS;
-        float rb = m_fRadE;
-        
-        float rba   = rb - ra;
-        float baba  = (b - a).fDot(b - a);
-        float papa  = (p - a).fDot(p - a);
-        float paba  = (p - a).fDot(b - a) / baba;
-        
-        // eliminate negative values
-        float x     = std::sqrt(std::max(   0.0f,
-                                            (float) (papa - paba * paba * baba)));
-        // eliminate negative values
-        float cax   = std::max( 0.0f,
-                                (float) (x - ((paba < 0.5f) ? ra : rb)));
-        
-        float cay   = std::abs(paba - 0.5f) - 0.5f;
-        float k     = rba * rba + baba;
-        float f     = Math::fClamp((rba * (x - ra) + paba * baba) / k, 0.0f, 1.0f);
-        float cbx   = x - ra - f * rba;
-        float cby   = paba - f;
-        float s     = (cbx < 0.0f && cay < 0.0f) ? -1.0f : 1.0f;
+        for (std::vector<float>* poArray : { &m_afAX, &m_afAY, &m_afAZ,
+                                             &m_afBAX, &m_afBAY, &m_afBAZ,
+                                             &m_afBABA, &m_afIBABA, &m_afRA,
+                                             &m_afRB, &m_afRBA, &m_afIK})
+        {
+            poArray->reserve(nCount);
+        }
+    }
+    
+    inline size_t nCount() const    {return m_afRA.size();}
+    
+    inline LatticeFlatConeConsts oConsts(size_t n) const
+    {
+        LatticeFlatConeConsts o;
+        o.fAX   = m_afAX[n];
+        o.fAY   = m_afAY[n];
+        o.fAZ   = m_afAZ[n];
+        o.fBAX  = m_afBAX[n];
+        o.fBAY  = m_afBAY[n];
+        o.fBAZ  = m_afBAZ[n];
+        o.fBABA = m_afBABA[n];
+        o.fIBABA= m_afIBABA[n];
+        o.fRA   = m_afRA[n];
+        o.fRB   = m_afRB[n];
+        o.fRBA  = m_afRBA[n];
+        o.fIK   = m_afIK[n];
+        return o;
+    }
+    
+    BBox3 oBBox(size_t n) const
+    {
+        Vector3 vecS(m_afAX[n], m_afAY[n], m_afAZ[n]);
         
-        return s * sqrtf(std::min(  cax * cax + cay * cay * baba,
-                                    cbx * cbx + cby * cby * baba));
+        BBox3 oBBox;
+        oBBox.Include(vecS);
+        oBBox.Include(vecS + Vector3(m_afBAX[n], m_afBAY[n], m_afBAZ[n]));
+        oBBox.Grow(std::max(m_afRA[n], m_afRB[n]));
+        return oBBox;
     }
     
-    Vector3 m_vecS;
-    Vector3 m_vecE;
-    float   m_fRadS;
-    float   m_fRadE;
-    bool    m_bRoundCap;
-    BBox3   m_oBBox;
+protected:
+    std::vector<float> m_afAX;
+    std::vector<float> m_afAY;
+    std::vector<float> m_afAZ;
+    std::vector<float> m_afBAX;
+    std::vector<float> m_afBAY;
+    std::vector<float> m_afBAZ;
+    std::vector<float> m_afBABA;
+    std::vector<float> m_afIBABA;
+    std::vector<float> m_afRA;
+    std::vector<float> m_afRB;
+    std::vector<float> m_afRBA;
+    std::vector<float> m_afIK;
 };
 
 class Lattice
@@ -195,9 +275,8 @@ public:
     void AddSphere( Vector3 vecCenter,
                     float fRadius)
     {
-        LatticeSphere::Ptr roSphere = std::make_shared<LatticeSphere>(vecCenter, fRadius);
-        m_oBBox.Include(roSphere->oBBox());
-        m_oSpheres.push_back(roSphere);
+        m_oSpheres.Add(vecCenter, fRadius);
+        m_oBBox.Include(m_oSpheres.oBBox(m_oSpheres.nCount() - 1));
     }
  
     void AddBeam(   Vector3 vecS,
@@ -213,13 +292,59 @@ public:
             return;
         }
         
-        LatticeBeam::Ptr roBeam = std::make_shared<LatticeBeam>(    vecS,
-                                                                    vecE,
-                                                                    fRadS,
-                                                                    fRadE,
-                                                                    bRoundCap);
-        m_oBBox.Include(roBeam->oBBox());
-        m_oBeams.push_back(roBeam);
+        if (bRoundCap)
+        {
+            m_oRoundCones.Add(vecS, vecE, fRadS, fRadE);
+            m_oBBox.Include(m_oRoundCones.oBBox(m_oRoundCones.nCount() - 1));
+        }
+        else
+        {
+            m_oFlatCones.Add(vecS, vecE, fRadS, fRadE);
+            m_oBBox.Include(m_oFlatCones.oBBox(m_oFlatCones.nCount() - 1));
+        }
+    }
+    
+    void AddSpheres(    const Vector3* pvecCenters,
+                        const float* pfRadii,
+                        size_t nCount)
+    {
+        m_oSpheres.Reserve(nGrownCapacity(m_oSpheres.nCount(), nCount));
+        
+        for (size_t n=0; n<nCount; n++)
+            AddSphere(pvecCenters[n], pfRadii[n]);
+    }
+    
+    void AddBeams(  const Vector3* pvecS,
+                    const Vector3* pvecE,
+                    const float* pfRadS,
+                    const float* pfRadE,
+                    const bool* pbRoundCap, // nullptr means all beams have round caps
+                    size_t nCount)
+    {
+        size_t nRound = nCount;
+        if (pbRoundCap != nullptr)
+            nRound = (size_t) std::count(pbRoundCap, pbRoundCap + nCount, true);
+        
+        m_oRoundCones.Reserve(nGrownCapacity(m_oRoundCones.nCount(), nRound));
+        m_oFlatCones.Reserve(nGrownCapacity(m_oFlatCones.nCount(), nCount - nRound));
+        
+        for (size_t n=0; n<nCount; n++)
+        {
+            AddBeam(    pvecS[n],
+                        pvecE[n],
+                        pfRadS[n],
+                        pfRadE[n],
+                        (pbRoundCap == nullptr) || pbRoundCap[n]);
+        }
+    }
+    
+    void Reserve(   size_t nSpheres,
+                    size_t nRoundCapBeams,
+                    size_t nFlatCapBeams)
+    {
+        m_oSpheres.Reserve(nSpheres);
+        m_oRoundCones.Reserve(nRoundCapBeams);
+        m_oFlatCones.Reserve(nFlatCapBeams);
     }
     
     inline const BBox3& oBBox() const
@@ -227,20 +352,33 @@ public:
         return m_oBBox;
     }
     
-    inline const std::vector<LatticeBeam::Ptr>& oBeams() const
+    inline const LatticeSpheres& oSpheres() const
     {
-        return m_oBeams;
+        return m_oSpheres;
     }
     
-    inline const std::vector<LatticeSphere::Ptr>& oSpheres() const
+    inline const LatticeRoundCones& oRoundCones() const
     {
-        return m_oSpheres;
+        return m_oRoundCones;
+    }
+    
+    inline const LatticeFlatCones& oFlatCones() const
+    {
+        return m_oFlatCones;
     }
     
 protected:
-    std::vector<LatticeBeam::Ptr>   m_oBeams;
-    std::vector<LatticeSphere::Ptr> m_oSpheres;
-    BBox3                           m_oBBox;
+    static size_t nGrownCapacity(   size_t nSize,
+                                    size_t nAdd)
+    {
+        // at least double, so repeated bulk adds stay linear
+        return std::max(nSize + nAdd, nSize * 2);
+    }
+    
+    LatticeSpheres      m_oSpheres;
+    LatticeRoundCones   m_oRoundCones;
+    LatticeFlatCones    m_oFlatCones;
+    BBox3               m_oBBox;
 };
 
 } //
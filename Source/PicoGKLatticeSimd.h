@@ -0,0 +1,455 @@
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// PicoGK ("peacock") is a compact software kernel for computational geometry,
+// specifically for use in Computational Engineering Models (CEM).
+//
+// For more information, please visit https://picogk.org
+//
+// PicoGK is developed and maintained by LEAP 71 - © 2023-2024 by LEAP 71
+// https://leap71.com
+//
+// Computational Engineering will profoundly change our physical world in the
+// years ahead. Thank you for being part of the journey.
+//
+// We have developed this library to be used widely, for both commercial and
+// non-commercial projects alike. Therefore, have released it under a permissive
+// open-source license.
+//
+// The foundation of PicoGK is a thin layer on top of the powerful open-source
+// OpenVDB project, which in turn uses many other Free and Open Source Software
+// libraries. We are grateful to be able to stand on the shoulders of giants.
+//
+// LEAP 71 licenses this file to you under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with the
+// License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, THE SOFTWARE IS
+// PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef PICOGKLATTICESIMD_H_
+#define PICOGKLATTICESIMD_H_
+
+#include "PicoGKTypes.h"
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define PICOGK_LATTICE_X86
+    #include <immintrin.h>
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+        #define PICOGK_TARGET_AVX2
+    #else
+        #define PICOGK_TARGET_AVX2 __attribute__((target("avx2,fma")))
+    #endif
+#endif
+
+namespace PicoGK
+{
+
+// Shape-only terms of the lattice primitives, computed once per
+// primitive, so evaluating a sample costs as little as possible
+
+struct LatticeSphereConsts
+{
+    float fCX, fCY, fCZ;
+    float fR;
+};
+
+struct LatticeRoundConeConsts
+{
+    float fAX, fAY, fAZ;    // start point
+    float fBAX, fBAY, fBAZ; // end - start
+    float fL2;              // squared length
+    float fIL2;             // 1 / squared length
+    float fRR;              // start radius - end radius
+    float fA2;              // l2 - rr^2
+    float fKRR;             // sign(rr) * rr^2
+    float fR1;              // start radius
+    float fR2;              // end radius
+};
+
+struct LatticeFlatConeConsts
+{
+    float fAX, fAY, fAZ;    // start point
+    float fBAX, fBAY, fBAZ; // end - start
+    float fBABA;            // squared length
+    float fIBABA;           // 1 / squared length
+    float fRA;              // start radius
+    float fRB;              // end radius
+    float fRBA;             // end radius - start radius
+    float fIK;              // 1 / (rba^2 + baba)
+};
+
+// Evaluates one primitive against a row of 8 samples, which share X and Y
+// and are spaced by fStepZ along Z, starting at fZ. This matches a row of
+// voxels in an OpenVDB leaf node. The AVX2 versions are selected at runtime
+// if the CPU supports them, otherwise the portable versions are used, which
+// are written without branches, so the compiler can vectorize them
+
+class LatticeSimd
+{
+public:
+    static constexpr int nRowSize = 8;
+
+    typedef void (*PFnSphereRow)(       const LatticeSphereConsts& o,
+                                        float fX,
+                                        float fY,
+                                        float fZ,
+                                        float fStepZ,
+                                        float* pfValues);
+
+    typedef void (*PFnRoundConeRow)(    const LatticeRoundConeConsts& o,
+                                        float fX,
+                                        float fY,
+                                        float fZ,
+                                        float fStepZ,
+                                        float* pfValues);
+
+    typedef void (*PFnFlatConeRow)(     const LatticeFlatConeConsts& o,
+                                        float fX,
+                                        float fY,
+                                        float fZ,
+                                        float fStepZ,
+                                        float* pfValues);
+
+    struct Kernels
+    {
+        PFnSphereRow        pfnSphereRow;
+        PFnRoundConeRow     pfnRoundConeRow;
+        PFnFlatConeRow      pfnFlatConeRow;
+    };
+
+    static const Kernels& oKernels()
+    {
+        static const Kernels oKernels = oSelectKernels();
+        return oKernels;
+    }
+
+    static const Kernels& oPortableKernels()
+    {
+        static const Kernels oKernels = {   SphereRow,
+                                            RoundConeRow,
+                                            FlatConeRow};
+        return oKernels;
+    }
+
+    static bool bHasAvx2()
+    {
+#if defined(PICOGK_LATTICE_X86)
+    #if defined(_MSC_VER)
+        int ai[4];
+        __cpuid(ai, 0);
+        if (ai[0] < 7)
+            return false;
+
+        __cpuid(ai, 1);
+        bool bFma       = (ai[2] & (1 << 12)) != 0;
+        bool bOsXSave   = (ai[2] & (1 << 27)) != 0;
+
+        if (!bFma || !bOsXSave)
+            return false;
+
+        // OS has to save the YMM registers
+        if ((_xgetbv(0) & 6) != 6)
+            return false;
+
+        __cpuidex(ai, 7, 0);
+        return (ai[1] & (1 << 5)) != 0;
+    #else
+        return  __builtin_cpu_supports("avx2") &&
+                __builtin_cpu_supports("fma");
+    #endif
+#else
+        return false;
+#endif
+    }
+
+    static void SphereRow(  const LatticeSphereConsts& o,
+                            float fX,
+                            float fY,
+                            float fZ,
+                            float fStepZ,
+                            float* pfValues)
+    {
+        float fDX = fX - o.fCX;
+        float fDY = fY - o.fCY;
+        float fXY = fDX * fDX + fDY * fDY;
+
+        for (int n=0; n<nRowSize; n++)
+        {
+            float fDZ   = fZ + n * fStepZ - o.fCZ;
+            pfValues[n] = std::sqrt(fXY + fDZ * fDZ) - o.fR;
+        }
+    }
+
+    static void RoundConeRow(   const LatticeRoundConeConsts& o,
+                                float fX,
+                                float fY,
+                                float fZ,
+                                float fStepZ,
+                                float* pfValues)
+    {
+        // Scalar reference for RoundConeRowAvx2, constants are set up
+        // in LatticeRoundCones::Add. Selects the result instead of
+        // branching, so only one square root is needed
+
+        float pax   = fX - o.fAX;
+        float pay   = fY - o.fAY;
+        float fYXY  = pax * o.fBAX + pay * o.fBAY;
+
+        for (int n=0; n<nRowSize; n++)
+        {
+            float paz   = fZ + n * fStepZ - o.fAZ;
+            float y     = fYXY + paz * o.fBAZ;
+            float z     = y - o.fL2;
+
+            float qx    = pax * o.fL2 - o.fBAX * y;
+            float qy    = pay * o.fL2 - o.fBAY * y;
+            float qz    = paz * o.fL2 - o.fBAZ * y;
+
+            float x2    = qx * qx + qy * qy + qz * qz;
+            float y2    = y * y * o.fL2;
+            float z2    = z * z * o.fL2;
+            float k     = o.fKRR * x2;
+
+            float fSignY = (float) ((0.0f < y) - (y < 0.0f));
+            float fSignZ = (float) ((0.0f < z) - (z < 0.0f));
+
+            bool bEnd   = fSignZ * o.fA2 * z2 > k;
+            bool bStart = fSignY * o.fA2 * y2 < k;
+
+            float fS    = bEnd ? (x2 + z2) : (bStart ? (x2 + y2) : (x2 * o.fA2 * o.fIL2));
+            float fT    = (bEnd || bStart) ? 0.0f : y * o.fRR;
+            float fR    = bEnd ? o.fR2 : o.fR1;
+
+            pfValues[n] = (std::sqrt(fS) + fT) * o.fIL2 - fR;
+        }
+    }
+
+    static void FlatConeRow(    const LatticeFlatConeConsts& o,
+                                float fX,
+                                float fY,
+                                float fZ,
+                                float fStepZ,
+                                float* pfValues)
+    {
+        // Scalar reference for FlatConeRowAvx2, constants are set up
+        // in LatticeFlatCones::Add
+
+        float pax   = fX - o.fAX;
+        float pay   = fY - o.fAY;
+        float fPAXY = pax * pax + pay * pay;
+        float fBAXY = pax * o.fBAX + pay * o.fBAY;
+
+        for (int n=0; n<nRowSize; n++)
+        {
+            float paz   = fZ + n * fStepZ - o.fAZ;
+            float papa  = fPAXY + paz * paz;
+            float paba  = (fBAXY + paz * o.fBAZ) * o.fIBABA;
+
+            float x     = std::sqrt(std::max(0.0f, papa - paba * paba * o.fBABA));
+            float cax   = std::max(0.0f, x - ((paba < 0.5f) ? o.fRA : o.fRB));
+            float cay   = std::abs(paba - 0.5f) - 0.5f;
+            float f     = std::min(1.0f, std::max(0.0f, (o.fRBA * (x - o.fRA) + paba * o.fBABA) * o.fIK));
+            float cbx   = x - o.fRA - f * o.fRBA;
+            float cby   = paba - f;
+            float s     = (cbx < 0.0f && cay < 0.0f) ? -1.0f : 1.0f;
+
+            pfValues[n] = s * std::sqrt(std::min(   cax * cax + cay * cay * o.fBABA,
+                                                    cbx * cbx + cby * cby * o.fBABA));
+        }
+    }
+
+#if defined(PICOGK_LATTICE_X86)
+
+    PICOGK_TARGET_AVX2
+    static void SphereRowAvx2(  const LatticeSphereConsts& o,
+                                float fX,
+                                float fY,
+                                float fZ,
+                                float fStepZ,
+                                float* pfValues)
+    {
+        float fDX = fX - o.fCX;
+        float fDY = fY - o.fCY;
+
+        __m256 vDZ = _mm256_sub_ps( vecLanesAvx2(fZ, fStepZ),
+                                    _mm256_set1_ps(o.fCZ));
+
+        __m256 vD2 = _mm256_fmadd_ps(   vDZ,
+                                        vDZ,
+                                        _mm256_set1_ps(fDX * fDX + fDY * fDY));
+
+        _mm256_storeu_ps(pfValues, _mm256_sub_ps(   _mm256_sqrt_ps(vD2),
+                                                    _mm256_set1_ps(o.fR)));
+    }
+
+    PICOGK_TARGET_AVX2
+    static void RoundConeRowAvx2(   const LatticeRoundConeConsts& o,
+                                    float fX,
+                                    float fY,
+                                    float fZ,
+                                    float fStepZ,
+                                    float* pfValues)
+    {
+        // Same as RoundConeRow, eight samples at a time
+
+        const __m256 vZero  = _mm256_setzero_ps();
+        const __m256 vOne   = _mm256_set1_ps(1.0f);
+        const __m256 vL2    = _mm256_set1_ps(o.fL2);
+        const __m256 vA2    = _mm256_set1_ps(o.fA2);
+
+        float pax   = fX - o.fAX;
+        float pay   = fY - o.fAY;
+
+        __m256 paz  = _mm256_sub_ps(vecLanesAvx2(fZ, fStepZ), _mm256_set1_ps(o.fAZ));
+
+        __m256 y    = _mm256_fmadd_ps(  paz,
+                                        _mm256_set1_ps(o.fBAZ),
+                                        _mm256_set1_ps(pax * o.fBAX + pay * o.fBAY));
+
+        __m256 z    = _mm256_sub_ps(y, vL2);
+
+        // q = pa * l2 - ba * y
+        __m256 qx   = _mm256_fnmadd_ps(_mm256_set1_ps(o.fBAX), y, _mm256_set1_ps(pax * o.fL2));
+        __m256 qy   = _mm256_fnmadd_ps(_mm256_set1_ps(o.fBAY), y, _mm256_set1_ps(pay * o.fL2));
+        __m256 qz   = _mm256_fnmadd_ps(_mm256_set1_ps(o.fBAZ), y, _mm256_mul_ps(paz, vL2));
+
+        __m256 x2   = _mm256_fmadd_ps(qz, qz, _mm256_fmadd_ps(qy, qy, _mm256_mul_ps(qx, qx)));
+        __m256 y2   = _mm256_mul_ps(_mm256_mul_ps(y, y), vL2);
+        __m256 z2   = _mm256_mul_ps(_mm256_mul_ps(z, z), vL2);
+        __m256 k    = _mm256_mul_ps(_mm256_set1_ps(o.fKRR), x2);
+
+        __m256 vSignY = _mm256_sub_ps(  _mm256_and_ps(_mm256_cmp_ps(y, vZero, _CMP_GT_OQ), vOne),
+                                        _mm256_and_ps(_mm256_cmp_ps(y, vZero, _CMP_LT_OQ), vOne));
+
+        __m256 vSignZ = _mm256_sub_ps(  _mm256_and_ps(_mm256_cmp_ps(z, vZero, _CMP_GT_OQ), vOne),
+                                        _mm256_and_ps(_mm256_cmp_ps(z, vZero, _CMP_LT_OQ), vOne));
+
+        __m256 bEnd     = _mm256_cmp_ps(    _mm256_mul_ps(vSignZ, _mm256_mul_ps(vA2, z2)),
+                                            k,
+                                            _CMP_GT_OQ);
+
+        __m256 bStart   = _mm256_cmp_ps(    _mm256_mul_ps(vSignY, _mm256_mul_ps(vA2, y2)),
+                                            k,
+                                            _CMP_LT_OQ);
+
+        __m256 vS   = _mm256_mul_ps(x2, _mm256_set1_ps(o.fA2 * o.fIL2));
+        vS          = _mm256_blendv_ps(vS, _mm256_add_ps(x2, y2), bStart);
+        vS          = _mm256_blendv_ps(vS, _mm256_add_ps(x2, z2), bEnd);
+
+        __m256 vT   = _mm256_andnot_ps( _mm256_or_ps(bEnd, bStart),
+                                        _mm256_mul_ps(y, _mm256_set1_ps(o.fRR)));
+
+        __m256 vR   = _mm256_blendv_ps( _mm256_set1_ps(o.fR1),
+                                        _mm256_set1_ps(o.fR2),
+                                        bEnd);
+
+        __m256 vResult = _mm256_sub_ps( _mm256_mul_ps(  _mm256_add_ps(_mm256_sqrt_ps(vS), vT),
+                                                        _mm256_set1_ps(o.fIL2)),
+                                        vR);
+
+        _mm256_storeu_ps(pfValues, vResult);
+    }
+
+    PICOGK_TARGET_AVX2
+    static void FlatConeRowAvx2(    const LatticeFlatConeConsts& o,
+                                    float fX,
+                                    float fY,
+                                    float fZ,
+                                    float fStepZ,
+                                    float* pfValues)
+    {
+        // Same as FlatConeRow, eight samples at a time
+
+        const __m256 vZero  = _mm256_setzero_ps();
+        const __m256 vHalf  = _mm256_set1_ps(0.5f);
+        const __m256 vOne   = _mm256_set1_ps(1.0f);
+        const __m256 vBABA  = _mm256_set1_ps(o.fBABA);
+        const __m256 vRA    = _mm256_set1_ps(o.fRA);
+        const __m256 vRBA   = _mm256_set1_ps(o.fRBA);
+
+        float pax   = fX - o.fAX;
+        float pay   = fY - o.fAY;
+
+        __m256 paz  = _mm256_sub_ps(vecLanesAvx2(fZ, fStepZ), _mm256_set1_ps(o.fAZ));
+
+        __m256 papa = _mm256_fmadd_ps(  paz,
+                                        paz,
+                                        _mm256_set1_ps(pax * pax + pay * pay));
+
+        __m256 paba = _mm256_mul_ps(    _mm256_fmadd_ps(    paz,
+                                                            _mm256_set1_ps(o.fBAZ),
+                                                            _mm256_set1_ps(pax * o.fBAX + pay * o.fBAY)),
+                                        _mm256_set1_ps(o.fIBABA));
+
+        __m256 x    = _mm256_sqrt_ps(_mm256_max_ps( vZero,
+                                                    _mm256_fnmadd_ps(_mm256_mul_ps(paba, paba), vBABA, papa)));
+
+        __m256 vRadius = _mm256_blendv_ps(  _mm256_set1_ps(o.fRB),
+                                            vRA,
+                                            _mm256_cmp_ps(paba, vHalf, _CMP_LT_OQ));
+
+        __m256 cax  = _mm256_max_ps(vZero, _mm256_sub_ps(x, vRadius));
+
+        // abs by clearing the sign bit
+        __m256 cay  = _mm256_sub_ps(    _mm256_andnot_ps(   _mm256_set1_ps(-0.0f),
+                                                            _mm256_sub_ps(paba, vHalf)),
+                                        vHalf);
+
+        __m256 f    = _mm256_mul_ps(    _mm256_fmadd_ps(vRBA, _mm256_sub_ps(x, vRA), _mm256_mul_ps(paba, vBABA)),
+                                        _mm256_set1_ps(o.fIK));
+
+        f           = _mm256_min_ps(vOne, _mm256_max_ps(vZero, f));
+
+        __m256 cbx  = _mm256_fnmadd_ps(f, vRBA, _mm256_sub_ps(x, vRA));
+        __m256 cby  = _mm256_sub_ps(paba, f);
+
+        __m256 bInside = _mm256_and_ps( _mm256_cmp_ps(cbx, vZero, _CMP_LT_OQ),
+                                        _mm256_cmp_ps(cay, vZero, _CMP_LT_OQ));
+
+        __m256 s    = _mm256_blendv_ps(vOne, _mm256_set1_ps(-1.0f), bInside);
+
+        __m256 d1   = _mm256_fmadd_ps(_mm256_mul_ps(cay, cay), vBABA, _mm256_mul_ps(cax, cax));
+        __m256 d2   = _mm256_fmadd_ps(_mm256_mul_ps(cby, cby), vBABA, _mm256_mul_ps(cbx, cbx));
+
+        _mm256_storeu_ps(pfValues, _mm256_mul_ps(s, _mm256_sqrt_ps(_mm256_min_ps(d1, d2))));
+    }
+
+    PICOGK_TARGET_AVX2
+    static __m256 vecLanesAvx2( float fStart,
+                                float fStep)
+    {
+        return _mm256_fmadd_ps( _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f),
+                                _mm256_set1_ps(fStep),
+                                _mm256_set1_ps(fStart));
+    }
+
+#endif
+
+protected:
+    static Kernels oSelectKernels()
+    {
+#if defined(PICOGK_LATTICE_X86)
+        if (bHasAvx2())
+        {
+            Kernels oAvx2 = {   SphereRowAvx2,
+                                RoundConeRowAvx2,
+                                FlatConeRowAvx2};
+            return oAvx2;
+        }
+#endif
+        return oPortableKernels();
+    }
+};
+
+} // namespace PicoGK
+
+#endif // PICOGKLATTICESIMD_H_
@@ -61,6 +61,21 @@ PICOGK_API void Library_Destroy()
     Library::oLib().DestroyLibrary();
 }
 
+PICOGK_API void Library_SetRenormalizeAfterRender(bool bRenormalize)
+{
+    Library::oLib().SetRenormalizeAfterRender(bRenormalize);
+}
+
+PICOGK_API void Library_SetAutoCompact(bool bAutoCompact)
+{
+    Library::oLib().SetAutoCompact(bAutoCompact);
+}
+
+PICOGK_API int64_t Library_nAutoCompactedBytes()
+{
+    return Library::oLib().nAutoCompactedBytes();
+}
+
 PICOGK_API void Library_GetName(char psz[PKINFOSTRINGLEN])
 {
    SafeCopyInfoString(Library::oLib().strName(), psz);
@@ -105,6 +120,15 @@ PICOGK_API PKMESH Mesh_hCreateFromVoxels(PKVOXELS hVoxels)
     return (PKMESH) Library::oLib().proMeshCreateFromVoxels(**proVoxels);
 }
 
+PICOGK_API PKMESH Mesh_hCreateFromVoxelsAdaptive(   PKVOXELS hVoxels,
+                                                    float fAdaptivity)
+{
+    Voxels::Ptr* proVoxels = (Voxels::Ptr*) hVoxels;
+    assert(Library::oLib().bVoxelsIsValid(proVoxels));
+    
+    return (PKMESH) Library::oLib().proMeshCreateFromVoxels(**proVoxels, fAdaptivity);
+}
+
 PICOGK_API bool Mesh_bIsValid(PKMESH hThis)
 {
     Mesh::Ptr* proThis = (Mesh::Ptr*) hThis;
@@ -128,6 +152,19 @@ PICOGK_API int32_t Mesh_nAddVertex( PKMESH hThis,
     return (*proThis)->nAddVertex(*pvecVertex);
 }
     
+PICOGK_API int32_t Mesh_nAddVertices(   PKMESH hThis,
+                                        const Vector3* pvecVertices,
+                                        int32_t nCount)
+{
+    Mesh::Ptr* proThis = (Mesh::Ptr*) hThis;
+    assert(Library::oLib().bMeshIsValid(proThis));
+    
+    if (nCount <= 0)
+        return (*proThis)->nVertexCount();
+    
+    return (*proThis)->nAddVertices(pvecVertices, nCount);
+}
+    
 PICOGK_API void Mesh_GetVertex( PKMESH      hThis,
                                 int32_t     nVertex,
                                 Vector3*    pvecVertex)
@@ -155,6 +192,29 @@ PICOGK_API int32_t Mesh_nAddTriangle(   PKMESH hThis,
     return (*proThis)->nAddTriangle(*psTri);
 }
 
+PICOGK_API int32_t Mesh_nAddTriangles(  PKMESH hThis,
+                                        const Triangle* psTriangles,
+                                        int32_t nCount)
+{
+    Mesh::Ptr* proThis = (Mesh::Ptr*) hThis;
+    assert(Library::oLib().bMeshIsValid(proThis));
+    
+    if (nCount <= 0)
+        return (*proThis)->nTriangleCount();
+    
+    return (*proThis)->nAddTriangles(psTriangles, nCount);
+}
+
+PICOGK_API void Mesh_Reserve(   PKMESH hThis,
+                                int32_t nVertices,
+                                int32_t nTriangles)
+{
+    Mesh::Ptr* proThis = (Mesh::Ptr*) hThis;
+    assert(Library::oLib().bMeshIsValid(proThis));
+    
+    (*proThis)->Reserve(nVertices, nTriangles);
+}
+
 PICOGK_API void Mesh_GetTriangle(   PKMESH hThis,
                                     int32_t nTriangle,
                                     Triangle* psTri)
@@ -181,6 +241,44 @@ PICOGK_API void Mesh_GetTriangleV(  PKMESH      hThis,
                                 pvecC);
 }
 
+PICOGK_API void Mesh_GetVertices(   PKMESH      hThis,
+                                    int32_t     nStart,
+                                    int32_t     nCount,
+                                    Vector3*    pvecVertices)
+{
+    Mesh::Ptr* proThis = (Mesh::Ptr*) hThis;
+    assert(Library::oLib().bMeshIsValid(proThis));
+    
+    (*proThis)->GetVertices(nStart, nCount, pvecVertices);
+}
+
+PICOGK_API void Mesh_GetTriangles(  PKMESH      hThis,
+                                    int32_t     nStart,
+                                    int32_t     nCount,
+                                    Triangle*   psTriangles)
+{
+    Mesh::Ptr* proThis = (Mesh::Ptr*) hThis;
+    assert(Library::oLib().bMeshIsValid(proThis));
+    
+    (*proThis)->GetTriangles(nStart, nCount, psTriangles);
+}
+
+PICOGK_API const Vector3* Mesh_pVertexData(PKMESH hThis)
+{
+    Mesh::Ptr* proThis = (Mesh::Ptr*) hThis;
+    assert(Library::oLib().bMeshIsValid(proThis));
+    
+    return (const Vector3*) (*proThis)->pVertexData();
+}
+
+PICOGK_API const Triangle* Mesh_pTriangleData(PKMESH hThis)
+{
+    Mesh::Ptr* proThis = (Mesh::Ptr*) hThis;
+    assert(Library::oLib().bMeshIsValid(proThis));
+    
+    return (const Triangle*) (*proThis)->pTriangleData();
+}
+
 PICOGK_API void Mesh_GetBoundingBox(    PKMESH hThis,
                                         BBox3* poBox)
 {
@@ -190,6 +288,101 @@ PICOGK_API void Mesh_GetBoundingBox(    PKMESH hThis,
     (*proThis)->GetBoundingBox(poBox);
 }
 
+PICOGK_API int32_t Mesh_nDecimate(  PKMESH hThis,
+                                    int32_t nTargetTriangles,
+                                    float fMaxDeviationMM)
+{
+    Mesh::Ptr* proThis = (Mesh::Ptr*) hThis;
+    assert(Library::oLib().bMeshIsValid(proThis));
+    
+    MeshDecimator::Decimate(**proThis, nTargetTriangles, fMaxDeviationMM);
+    return (*proThis)->nTriangleCount();
+}
+
+PICOGK_API bool Mesh_bClosestPoint( PKMESH hThis,
+                                    const PKVector3* pvecPoint,
+                                    PKVector3* pvecClosest,
+                                    int32_t* pnTriangle,
+                                    float* pfDistance)
+{
+    Mesh::Ptr* proThis = (Mesh::Ptr*) hThis;
+    assert(Library::oLib().bMeshIsValid(proThis));
+    
+    Vector3 vecClosest;
+    int32_t nTriangle;
+    float fDistance;
+    
+    if (!(*proThis)->bClosestPoint(*pvecPoint, &vecClosest, &nTriangle, &fDistance))
+        return false;
+    
+    if (pvecClosest != nullptr)
+        *pvecClosest = vecClosest;
+    
+    if (pnTriangle != nullptr)
+        *pnTriangle = nTriangle;
+    
+    if (pfDistance != nullptr)
+        *pfDistance = fDistance;
+    
+    return true;
+}
+
+PICOGK_API void Mesh_ClosestPoints( PKMESH hThis,
+                                    int32_t nPoints,
+                                    const PKVector3* pvecPoints,
+                                    PKVector3* pvecClosest,
+                                    int32_t* pnTriangles,
+                                    float* pfDistances)
+{
+    Mesh::Ptr* proThis = (Mesh::Ptr*) hThis;
+    assert(Library::oLib().bMeshIsValid(proThis));
+    
+    (*proThis)->ClosestPoints(nPoints, pvecPoints, pvecClosest, pnTriangles, pfDistances);
+}
+
+PICOGK_API void Mesh_RayCastBatch(  PKMESH hThis,
+                                    int32_t nRays,
+                                    const PKVector3* pvecOrigins,
+                                    const PKVector3* pvecDirections,
+                                    bool* pbHits,
+                                    PKVector3* pvecHits,
+                                    int32_t* pnTriangles,
+                                    float* pfDistances)
+{
+    Mesh::Ptr* proThis = (Mesh::Ptr*) hThis;
+    assert(Library::oLib().bMeshIsValid(proThis));
+    
+    (*proThis)->RayCastBatch(   nRays,
+                                pvecOrigins,
+                                pvecDirections,
+                                pbHits,
+                                pvecHits,
+                                pnTriangles,
+                                pfDistances);
+}
+
+PICOGK_API void Mesh_GetNearestSurfaceNormals( PKMESH hThis,
+                                                int32_t nPoints,
+                                                const PKVector3* pvecPoints,
+                                                PKVector3* pvecNormals)
+{
+    Mesh::Ptr* proThis = (Mesh::Ptr*) hThis;
+    assert(Library::oLib().bMeshIsValid(proThis));
+    
+    (*proThis)->GetNearestSurfaceNormals(nPoints, pvecPoints, pvecNormals);
+}
+
+PICOGK_API void Mesh_SignedDistances(   PKMESH hThis,
+                                        int32_t nPoints,
+                                        const PKVector3* pvecPoints,
+                                        float* pfDistances)
+{
+    Mesh::Ptr* proThis = (Mesh::Ptr*) hThis;
+    assert(Library::oLib().bMeshIsValid(proThis));
+    
+    (*proThis)->SignedDistances(nPoints, pvecPoints, pfDistances);
+}
+
 PICOGK_API int32_t Mesh_nTriangleCount(PKMESH hThis)
 {
     Mesh::Ptr* proThis = (Mesh::Ptr*) hThis;
@@ -243,6 +436,57 @@ PICOGK_API void Lattice_AddBeam(    PKLATTICE hThis,
                             bRoundCap);
 }
 
+PICOGK_API void Lattice_AddSpheres( PKLATTICE hThis,
+                                    const Vector3* pvecCenters,
+                                    const float* pfRadii,
+                                    int32_t nCount)
+{
+    Lattice::Ptr* proThis = (Lattice::Ptr*) hThis;
+    assert(Library::oLib().bLatticeIsValid(proThis));
+    
+    if (nCount <= 0)
+        return;
+    
+    (*proThis)->AddSpheres( pvecCenters,
+                            pfRadii,
+                            (size_t) nCount);
+}
+
+PICOGK_API void Lattice_AddBeams(   PKLATTICE hThis,
+                                    const Vector3* pvecA,
+                                    const Vector3* pvecB,
+                                    const float* pfRadiusA,
+                                    const float* pfRadiusB,
+                                    const bool* pbRoundCap,
+                                    int32_t nCount)
+{
+    Lattice::Ptr* proThis = (Lattice::Ptr*) hThis;
+    assert(Library::oLib().bLatticeIsValid(proThis));
+    
+    if (nCount <= 0)
+        return;
+    
+    (*proThis)->AddBeams(   pvecA,
+                            pvecB,
+                            pfRadiusA,
+                            pfRadiusB,
+                            pbRoundCap,
+                            (size_t) nCount);
+}
+
+PICOGK_API void Lattice_Reserve(    PKLATTICE hThis,
+                                    int32_t nSpheres,
+                                    int32_t nRoundCapBeams,
+                                    int32_t nFlatCapBeams)
+{
+    Lattice::Ptr* proThis = (Lattice::Ptr*) hThis;
+    assert(Library::oLib().bLatticeIsValid(proThis));
+    
+    (*proThis)->Reserve(    (size_t) std::max(0, nSpheres),
+                            (size_t) std::max(0, nRoundCapBeams),
+                            (size_t) std::max(0, nFlatCapBeams));
+}
+
 PICOGK_API PKVOXELS Voxels_hCreate()
 {
     return (PKVOXELS) Library::oLib().proVoxelsCreate();
@@ -306,6 +550,78 @@ PICOGK_API void Voxels_BoolIntersect(   PKVOXELS hThis,
     (*proThis)->BoolIntersect(**proOther);
 }
 
+PICOGK_API void Voxels_BoolAddMany( PKVOXELS hThis,
+                                    const PKVOXELS* phOperands,
+                                    int32_t nCount)
+{
+    Voxels::Ptr* proThis = (Voxels::Ptr*) hThis;
+    assert(Library::oLib().bVoxelsIsValid(proThis));
+    
+    std::vector<const Voxels*> oOperands;
+    for (int32_t n=0; n<nCount; n++)
+    {
+        Voxels::Ptr* proOperand = (Voxels::Ptr*) phOperands[n];
+        assert(Library::oLib().bVoxelsIsValid(proOperand));
+        oOperands.push_back(proOperand->get());
+    }
+    
+    (*proThis)->BoolAddMany(oOperands);
+}
+
+PICOGK_API void Voxels_BoolSubtractMany(    PKVOXELS hThis,
+                                            const PKVOXELS* phOperands,
+                                            int32_t nCount)
+{
+    Voxels::Ptr* proThis = (Voxels::Ptr*) hThis;
+    assert(Library::oLib().bVoxelsIsValid(proThis));
+    
+    std::vector<const Voxels*> oOperands;
+    for (int32_t n=0; n<nCount; n++)
+    {
+        Voxels::Ptr* proOperand = (Voxels::Ptr*) phOperands[n];
+        assert(Library::oLib().bVoxelsIsValid(proOperand));
+        oOperands.push_back(proOperand->get());
+    }
+    
+    (*proThis)->BoolSubtractMany(oOperands);
+}
+
+PICOGK_API void Voxels_BoolAddConsume( PKVOXELS hThis,
+                                       PKVOXELS hOther)
+{
+    Voxels::Ptr* proThis = (Voxels::Ptr*) hThis;
+    assert(Library::oLib().bVoxelsIsValid(proThis));
+    
+    Voxels::Ptr* proOther = (Voxels::Ptr*) hOther;
+    assert(Library::oLib().bVoxelsIsValid(proOther));
+    
+    (*proThis)->BoolAddConsume(**proOther);
+}
+
+PICOGK_API void Voxels_BoolSubtractConsume( PKVOXELS hThis,
+                                            PKVOXELS hOther)
+{
+    Voxels::Ptr* proThis = (Voxels::Ptr*) hThis;
+    assert(Library::oLib().bVoxelsIsValid(proThis));
+    
+    Voxels::Ptr* proOther = (Voxels::Ptr*) hOther;
+    assert(Library::oLib().bVoxelsIsValid(proOther));
+    
+    (*proThis)->BoolSubtractConsume(**proOther);
+}
+
+PICOGK_API void Voxels_BoolIntersectConsume( PKVOXELS hThis,
+                                             PKVOXELS hOther)
+{
+    Voxels::Ptr* proThis = (Voxels::Ptr*) hThis;
+    assert(Library::oLib().bVoxelsIsValid(proThis));
+    
+    Voxels::Ptr* proOther = (Voxels::Ptr*) hOther;
+    assert(Library::oLib().bVoxelsIsValid(proOther));
+    
+    (*proThis)->BoolIntersectConsume(**proOther);
+}
+
 PICOGK_API void Voxels_Offset(  PKVOXELS hThis,
                                 float fDist)
 {
@@ -334,6 +650,19 @@ PICOGK_API void Voxels_TripleOffset(    PKVOXELS hThis,
     (*proThis)->TripleOffset(fDist, Library::oLib().fVoxelSizeMM());
 }
 
+PICOGK_API void Voxels_Smoothen(    PKVOXELS    hThis,
+                                    float       fDist,
+                                    int32_t     eMode)
+{
+    Voxels::Ptr* proThis = (Voxels::Ptr*) hThis;
+    assert(Library::oLib().bVoxelsIsValid(proThis));
+    assert((eMode >= PKSMOOTH_OPEN) && (eMode <= PKSMOOTH_OPENCLOSE));
+    
+    (*proThis)->Smoothen(   fDist,
+                            (Voxels::ESmoothMode) eMode,
+                            Library::oLib().fVoxelSizeMM());
+}
+
 PICOGK_API void Voxels_Gaussian(    PKVOXELS    hThis,
                                     float       fSize)
 {
@@ -361,6 +690,57 @@ PICOGK_API void Voxels_Mean(    PKVOXELS    hThis,
     (*proThis)->Mean(fSize, Library::oLib().fVoxelSizeMM());
 }
 
+PICOGK_API void Voxels_FilterInBBox(    PKVOXELS        hThis,
+                                        int32_t         eFilter,
+                                        float           fDist,
+                                        const PKBBox3*  poBBox)
+{
+    Voxels::Ptr* proThis = (Voxels::Ptr*) hThis;
+    assert(Library::oLib().bVoxelsIsValid(proThis));
+    assert((eFilter >= PKFILTER_OFFSET) && (eFilter <= PKFILTER_MEAN));
+    
+    (*proThis)->FilterInBBox(   (Voxels::EFilter) eFilter,
+                                fDist,
+                                *poBBox,
+                                Library::oLib().fVoxelSizeMM());
+}
+
+PICOGK_API void Voxels_FilterMasked(    PKVOXELS    hThis,
+                                        int32_t     eFilter,
+                                        float       fDist,
+                                        PKVOXELS    hMask)
+{
+    Voxels::Ptr* proThis = (Voxels::Ptr*) hThis;
+    assert(Library::oLib().bVoxelsIsValid(proThis));
+    assert((eFilter >= PKFILTER_OFFSET) && (eFilter <= PKFILTER_MEAN));
+    
+    Voxels::Ptr* proMask = (Voxels::Ptr*) hMask;
+    assert(Library::oLib().bVoxelsIsValid(proMask));
+    
+    (*proThis)->FilterMasked(   (Voxels::EFilter) eFilter,
+                                fDist,
+                                **proMask,
+                                Library::oLib().fVoxelSizeMM());
+}
+
+PICOGK_API void Voxels_FilterScalarMasked(  PKVOXELS        hThis,
+                                            int32_t         eFilter,
+                                            float           fDist,
+                                            PKSCALARFIELD   hMask)
+{
+    Voxels::Ptr* proThis = (Voxels::Ptr*) hThis;
+    assert(Library::oLib().bVoxelsIsValid(proThis));
+    assert((eFilter >= PKFILTER_OFFSET) && (eFilter <= PKFILTER_MEAN));
+    
+    ScalarField::Ptr* proMask = (ScalarField::Ptr*) hMask;
+    assert(Library::oLib().bScalarFieldIsValid(proMask));
+    
+    (*proThis)->FilterAlphaMasked(  (Voxels::EFilter) eFilter,
+                                    fDist,
+                                    *(*proMask)->roVdbGrid(),
+                                    Library::oLib().fVoxelSizeMM());
+}
+
 PICOGK_API void Voxels_RenderMesh(  PKVOXELS hThis,
                                     PKMESH hMesh)
 {
@@ -373,6 +753,20 @@ PICOGK_API void Voxels_RenderMesh(  PKVOXELS hThis,
     (*proThis)->RenderMesh(**proMesh, Library::oLib().fVoxelSizeMM());
 }
 
+PICOGK_API void Voxels_RenderMeshImplicit(  PKVOXELS hThis,
+                                            PKMESH hMesh)
+{
+    Voxels::Ptr* proThis = (Voxels::Ptr*) hThis;
+    assert(Library::oLib().bVoxelsIsValid(proThis));
+    
+    Mesh::Ptr* proMesh = (Mesh::Ptr*) hMesh;
+    assert(Library::oLib().bMeshIsValid(proMesh));
+    
+    (*proThis)->RenderMeshImplicit(**proMesh, Library::oLib().fVoxelSizeMM());
+    
+    Library::oLib().FinishRender(**proThis);
+}
+
 PICOGK_API void Voxels_RenderImplicit(  PKVOXELS hThis,
                                         const PKBBox3* poBBox,
                                         PKPFnfSdf pfnSDF)
@@ -381,6 +775,36 @@ PICOGK_API void Voxels_RenderImplicit(  PKVOXELS hThis,
     assert(Library::oLib().bVoxelsIsValid(proThis));
     
     (*proThis)->RenderImplicit(*poBBox, pfnSDF, Library::oLib().fVoxelSizeMM());
+    
+    Library::oLib().FinishRender(**proThis);
+}
+
+PICOGK_API void Voxels_RenderImplicitParallel(  PKVOXELS hThis,
+                                                const PKBBox3* poBBox,
+                                                PKPFnfSdf pfnSDF)
+{
+    Voxels::Ptr* proThis = (Voxels::Ptr*) hThis;
+    assert(Library::oLib().bVoxelsIsValid(proThis));
+    
+    (*proThis)->RenderImplicitParallel(*poBBox, pfnSDF, Library::oLib().fVoxelSizeMM());
+    
+    Library::oLib().FinishRender(**proThis);
+}
+
+PICOGK_API void Voxels_RenderImplicitNarrowBand(    PKVOXELS hThis,
+                                                    const PKBBox3* poBBox,
+                                                    PKPFnfSdf pfnSDF,
+                                                    float fLipschitz)
+{
+    Voxels::Ptr* proThis = (Voxels::Ptr*) hThis;
+    assert(Library::oLib().bVoxelsIsValid(proThis));
+    
+    (*proThis)->RenderImplicitNarrowBand(   *poBBox,
+                                            pfnSDF,
+                                            fLipschitz,
+                                            Library::oLib().fVoxelSizeMM());
+    
+    Library::oLib().FinishRender(**proThis);
 }
 
 PICOGK_API void Voxels_IntersectImplicit(   PKVOXELS hThis,
@@ -390,6 +814,8 @@ PICOGK_API void Voxels_IntersectImplicit(   PKVOXELS hThis,
     assert(Library::oLib().bVoxelsIsValid(proThis));
     
     (*proThis)->IntersectImplicit(pfnSDF, Library::oLib().fVoxelSizeMM());
+    
+    Library::oLib().FinishRender(**proThis);
 }
 
 PICOGK_API void Voxels_RenderLattice(   PKVOXELS hThis,
@@ -402,6 +828,8 @@ PICOGK_API void Voxels_RenderLattice(   PKVOXELS hThis,
     assert(Library::oLib().bLatticeIsValid(proLattice));
     
     (*proThis)->RenderLattice(**proLattice, Library::oLib().fVoxelSizeMM());
+    
+    Library::oLib().FinishRender(**proThis);
 }
 
 PICOGK_API void Voxels_ProjectZSlice( PKVOXELS hThis,
@@ -414,6 +842,39 @@ PICOGK_API void Voxels_ProjectZSlice( PKVOXELS hThis,
     (*proThis)->ProjectZSlice(  fZStart,
                                 fZEnd,
                                 Library::oLib().fVoxelSizeMM());
+    
+    Library::oLib().FinishRender(**proThis);
+}
+
+PICOGK_API bool Voxels_bIsInside(   PKVOXELS hThis,
+                                    const PKVector3* pvecTestPoint)
+{
+    Voxels::Ptr* proThis = (Voxels::Ptr*) hThis;
+    assert(Library::oLib().bVoxelsIsValid(proThis));
+    
+    return (*proThis)->bIsInside(   *pvecTestPoint,
+                                    Library::oLib().fVoxelSizeMM());
+}
+
+PICOGK_API void Voxels_QueryPoints( PKVOXELS hThis,
+                                    int32_t nPoints,
+                                    const PKVector3* pvecPoints,
+                                    bool* pbInside,
+                                    float* pfSdValues,
+                                    PKVector3* pvecNormals)
+{
+    Voxels::Ptr* proThis = (Voxels::Ptr*) hThis;
+    assert(Library::oLib().bVoxelsIsValid(proThis));
+    
+    if (nPoints <= 0)
+        return;
+    
+    (*proThis)->QueryPoints(    (size_t) nPoints,
+                                pvecPoints,
+                                pbInside,
+                                pfSdValues,
+                                pvecNormals,
+                                Library::oLib().fVoxelSizeMM());
 }
 
 PICOGK_API bool Voxels_bIsEqual(    PKVOXELS hThis,
@@ -428,6 +889,22 @@ PICOGK_API bool Voxels_bIsEqual(    PKVOXELS hThis,
     return (*proThis)->bIsEqual(**proOther);
 }
 
+PICOGK_API bool Voxels_bIsEqualWithin(  PKVOXELS hThis,
+                                        PKVOXELS hOther,
+                                        float fToleranceMM)
+{
+    Voxels::Ptr* proThis = (Voxels::Ptr*) hThis;
+    assert(Library::oLib().bVoxelsIsValid(proThis));
+    
+    Voxels::Ptr* proOther = (Voxels::Ptr*) hOther;
+    assert(Library::oLib().bVoxelsIsValid(proOther));
+    
+    VoxelSize oVoxelSize(Library::oLib().fVoxelSizeMM());
+    
+    return (*proThis)->bIsEqual(    **proOther,
+                                    oVoxelSize.fToVoxels(fToleranceMM));
+}
+
 PICOGK_API void Voxels_CalculateProperties( PKVOXELS hThis,
                                             float* pfVolume,
                                             BBox3* poBBox)
@@ -438,6 +915,26 @@ PICOGK_API void Voxels_CalculateProperties( PKVOXELS hThis,
     (*proThis)->CalculateProperties(pfVolume, poBBox, Library::oLib().fVoxelSizeMM());
 }
 
+PICOGK_API void Voxels_CalculateMassProperties( PKVOXELS    hThis,
+                                                float*      pfVolume,
+                                                float*      pfSurfaceArea,
+                                                PKVector3*  pvecCentroid,
+                                                PKVector3*  pvecInertiaDiag,
+                                                PKVector3*  pvecInertiaOffDiag,
+                                                PKBBox3*    poBBox)
+{
+    Voxels::Ptr* proThis = (Voxels::Ptr*) hThis;
+    assert(Library::oLib().bVoxelsIsValid(proThis));
+    
+    (*proThis)->CalculateMassProperties(    pfVolume,
+                                            pfSurfaceArea,
+                                            pvecCentroid,
+                                            pvecInertiaDiag,
+                                            pvecInertiaOffDiag,
+                                            poBBox,
+                                            Library::oLib().fVoxelSizeMM());
+}
+
 PICOGK_API void Voxels_GetSurfaceNormal(    PKVOXELS            hThis,
                                             const PKVector3*    pvecSurfacePoint,
                                             PKVector3*          pvecNormal)
@@ -474,6 +971,33 @@ PICOGK_API bool Voxels_bRayCastToSurface(   PKVOXELS            hThis,
                                             pvecSurfacePoint);
 }
 
+PICOGK_API void Voxels_RayCastBatch(    PKVOXELS            hThis,
+                                        int32_t             nRays,
+                                        const PKVector3*    pvecOrigins,
+                                        const PKVector3*    pvecDirections,
+                                        int32_t             nMaxHitsPerRay,
+                                        int32_t*            pnHitCounts,
+                                        PKVector3*          pvecHits,
+                                        PKVector3*          pvecNormals,
+                                        float*              pfDistances)
+{
+    Voxels::Ptr* proThis = (Voxels::Ptr*) hThis;
+    assert(Library::oLib().bVoxelsIsValid(proThis));
+    
+    if (nRays <= 0)
+        return;
+    
+    (*proThis)->RayCastBatch(   (size_t) nRays,
+                                pvecOrigins,
+                                pvecDirections,
+                                nMaxHitsPerRay,
+                                pnHitCounts,
+                                pvecHits,
+                                pvecNormals,
+                                pfDistances,
+                                Library::oLib().fVoxelSizeMM());
+}
+
 PICOGK_API void Voxels_GetVoxelDimensions(  PKVOXELS hThis,
                                             int32_t* pnXOrigin,
                                             int32_t* pnYOrigin,
@@ -493,6 +1017,36 @@ PICOGK_API void Voxels_GetVoxelDimensions(  PKVOXELS hThis,
                                             pnZSize);
 }
 
+PICOGK_API void Voxels_Renormalize(PKVOXELS hThis)
+{
+    Voxels::Ptr* proThis = (Voxels::Ptr*) hThis;
+    assert(Library::oLib().bVoxelsIsValid(proThis));
+    
+    (*proThis)->Renormalize();
+}
+
+PICOGK_API int64_t Voxels_nCompact(  PKVOXELS hThis,
+                                    bool bSignedFloodFill)
+{
+    Voxels::Ptr* proThis = (Voxels::Ptr*) hThis;
+    assert(Library::oLib().bVoxelsIsValid(proThis));
+    
+    return (*proThis)->nCompact(bSignedFloodFill);
+}
+
+PICOGK_API void Voxels_GetGridStatistics(   PKVOXELS hThis,
+                                            int64_t* pnActiveVoxels,
+                                            int64_t* pnLeafNodes,
+                                            int64_t* pnMemoryBytes)
+{
+    Voxels::Ptr* proThis = (Voxels::Ptr*) hThis;
+    assert(Library::oLib().bVoxelsIsValid(proThis));
+    
+    (*proThis)->GetGridStatistics(  pnActiveVoxels,
+                                    pnLeafNodes,
+                                    pnMemoryBytes);
+}
+
 PICOGK_API void Voxels_GetSlice(    PKVOXELS    hThis,
                                     int32_t     nZSlice,
                                     float*      pfBuffer,
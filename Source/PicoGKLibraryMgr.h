@@ -39,8 +39,10 @@
 #include "PicoGKBuild.h"
 #include <string>
 #include <map>
+#include <atomic>
 
 #include "PicoGKMesh.h"
+#include "PicoGKMeshDecimate.h"
 #include "PicoGKLattice.h"
 #include "PicoGKPolyLine.h"
 #include "PicoGKVdbVoxels.h"
@@ -135,6 +137,9 @@ public:
         /// this is a bit of a hack
     
         m_fVoxelSizeMM = 0.0f;
+        m_bRenormalizeAfterRender = false;
+        m_bAutoCompact  = false;
+        m_nAutoCompactedBytes = 0;
         
         m_oMeshList         .clear();
         m_oLatticeList      .clear();
@@ -157,6 +162,37 @@ public:
         return m_fVoxelSizeMM;
     }
     
+    inline bool bRenormalizeAfterRender() const
+    {
+        return m_bRenormalizeAfterRender;
+    }
+    
+    inline void SetRenormalizeAfterRender(bool bRenormalize)
+    {
+        m_bRenormalizeAfterRender = bRenormalize;
+    }
+    
+    inline void SetAutoCompact(bool bAutoCompact)
+    {
+        m_bAutoCompact = bAutoCompact;
+    }
+    
+    inline int64_t nAutoCompactedBytes() const
+    {
+        return m_nAutoCompactedBytes;
+    }
+    
+    void FinishRender(Voxels& oVoxels)
+    {
+        // Applies the library-wide policies after rendering into voxels
+        
+        if (m_bRenormalizeAfterRender)
+            oVoxels.Renormalize();
+        
+        if (m_bAutoCompact)
+            m_nAutoCompactedBytes += oVoxels.nCompact(false);
+    }
+    
 public:
     
     std::string strName() const
@@ -186,9 +222,10 @@ public:
 public: // Mesh Functions
     PK_IMPLEMENT_STANDARD_LIB_FUNCTIONS(Mesh)
     
-    Mesh::Ptr* proMeshCreateFromVoxels(const Voxels& oVoxels)
+    Mesh::Ptr* proMeshCreateFromVoxels( const Voxels& oVoxels,
+                                        float fAdaptivity = 0.0f)
     {
-        Mesh::Ptr   roMesh      = oVoxels.roAsMesh(fVoxelSizeMM());
+        Mesh::Ptr   roMesh      = oVoxels.roAsMesh(fVoxelSizeMM(), fAdaptivity);
         Mesh::Ptr*  proMesh     = new Mesh::Ptr(roMesh);
         m_oMeshList[proMesh]    = proMesh;
         return proMesh;
@@ -416,6 +453,9 @@ private:
     
 protected:
     float                               m_fVoxelSizeMM  = 0.0f;
+    bool                                m_bRenormalizeAfterRender = false;
+    bool                                m_bAutoCompact  = false;
+    std::atomic<int64_t>                m_nAutoCompactedBytes = 0;
     
     std::map<const Mesh::Ptr*,          Mesh::Ptr*>         m_oMeshList;
     std::map<const Lattice::Ptr*,       Lattice::Ptr*>      m_oLatticeList;
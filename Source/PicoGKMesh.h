@@ -37,10 +37,13 @@
 #define PICOGKMESH_H_
 
 #include "PicoGKTypes.h"
+#include "PicoGKMeshBvh.h"
 
 #include <memory>
 #include <vector>
 #include <cassert>
+#include <mutex>
+#include <limits>
 
 namespace PicoGK
 {
@@ -54,6 +57,13 @@ public:
     {
     }
     
+    inline Mesh(const Mesh& oSource)
+    :   m_oBBox(oSource.m_oBBox),
+        m_oVertices(oSource.m_oVertices),
+        m_oTriangles(oSource.m_oTriangles)
+    {
+    }
+    
     inline int32_t  nAddTriangle(   const Vector3& vecA,
                                     const Vector3& vecB,
                                     const Vector3& vecC)
@@ -77,9 +87,87 @@ public:
         assert(sTri.B < nVertexCount());
         assert(sTri.C < nVertexCount());
         m_oTriangles.push_back(sTri);
+        m_roBvh.reset();
         return nTriangleCount() - 1;
     }
     
+    int32_t nAddVertices(   const Vector3* pvecVertices,
+                            int32_t nCount)
+    {
+        // Returns the index of the first added vertex
+        
+        int32_t nFirst = nVertexCount();
+        
+        if (nCount <= 0)
+            return nFirst;
+        
+        for (int32_t n=0; n<nCount; n++)
+            m_oBBox.Include(pvecVertices[n]);
+        
+        m_oVertices.insert(m_oVertices.end(), pvecVertices, pvecVertices + nCount);
+        return nFirst;
+    }
+    
+    int32_t nAddTriangles(  const Triangle* psTriangles,
+                            int32_t nCount)
+    {
+        // Returns the index of the first added triangle
+        
+        if (nCount <= 0)
+            return nTriangleCount();
+        
+#ifndef NDEBUG
+        for (int32_t n=0; n<nCount; n++)
+        {
+            assert(psTriangles[n].A < nVertexCount());
+            assert(psTriangles[n].B < nVertexCount());
+            assert(psTriangles[n].C < nVertexCount());
+        }
+#endif
+        
+        int32_t nFirst = nTriangleCount();
+        m_oTriangles.insert(m_oTriangles.end(), psTriangles, psTriangles + nCount);
+        m_roBvh.reset();
+        return nFirst;
+    }
+    
+    void Reserve(   int32_t nVertices,
+                    int32_t nTriangles)
+    {
+        m_oVertices.reserve((size_t) std::max(0, nVertices));
+        m_oTriangles.reserve((size_t) std::max(0, nTriangles));
+    }
+    
+    void GetVertices(   int32_t nStart,
+                        int32_t nCount,
+                        Vector3* pvecVertices) const
+    {
+        // Only the part of the range inside the mesh is copied
+        nCount = nClampedCount(nStart, nCount, nVertexCount());
+        
+        if (nCount == 0)
+            return;
+        
+        std::copy(  m_oVertices.begin() + nStart,
+                    m_oVertices.begin() + nStart + nCount,
+                    pvecVertices);
+    }
+    
+    void GetTriangles(  int32_t nStart,
+                        int32_t nCount,
+                        Triangle* psTriangles) const
+    {
+        // Only the part of the range inside the mesh is copied
+        nCount = nClampedCount(nStart, nCount, nTriangleCount());
+        
+        if (nCount == 0)
+            return;
+        
+        std::copy(  m_oTriangles.begin() + nStart,
+                    m_oTriangles.begin() + nStart + nCount,
+                    psTriangles);
+    }
+    
     inline int32_t nTriangleCount() const
     {
         size_t nSize = m_oTriangles.size();
@@ -121,30 +209,218 @@ public:
         *pvecC = m_oVertices.at(sTri.C);
     }
     
-    inline void GetBoundingBox(BBox3* poBBox)
+    inline void GetBoundingBox(BBox3* poBBox) const
     {
         *poBBox = m_oBBox;
     }
     
     bool bGetSurfaceNormal( const Vector3& vecSurfacePoint,
-                            Vector3* pvecNormal)
+                            Vector3* pvecNormal) const
+    {
+        // Normal of the triangle the point lies on, returns false
+        // if the point is not on the surface of the mesh
+        
+        Vector3 vecClosest;
+        int32_t nTriangle;
+        float fDistance;
+        
+        if (!roBvh()->bClosestPoint(vecSurfacePoint, &vecClosest, &nTriangle, &fDistance))
+            return false;
+        
+        float fTolerance = 1e-5f * std::max(1.0f, (m_oBBox.vecMax - m_oBBox.vecMin).fLength());
+        
+        if (fDistance > fTolerance)
+            return false;
+        
+        *pvecNormal = roBvh()->vecTriangleNormal((uint32_t) nTriangle);
+        return true;
+    }
+    
+    bool bGetNearestSurfaceNormal(  const Vector3& vecPoint,
+                                    Vector3* pvecNormal) const
+    {
+        // Normal of the triangle closest to the point, which can be
+        // anywhere, only fails if the mesh has no triangles
+        
+        Vector3 vecClosest;
+        int32_t nTriangle;
+        float fDistance;
+        
+        if (!roBvh()->bClosestPoint(vecPoint, &vecClosest, &nTriangle, &fDistance))
+            return false;
+        
+        *pvecNormal = roBvh()->vecTriangleNormal((uint32_t) nTriangle);
+        return true;
+    }
+    
+    bool bClosestPoint( const Vector3& vecPoint,
+                        Vector3* pvecClosest,
+                        int32_t* pnTriangle,
+                        float* pfDistance) const
+    {
+        return roBvh()->bClosestPoint(vecPoint, pvecClosest, pnTriangle, pfDistance);
+    }
+    
+    bool bRayCast(  const Vector3& vecOrigin,
+                    const Vector3& vecDirection,
+                    float* pfDistance,
+                    int32_t* pnTriangle) const
+    {
+        return roBvh()->bRayCast(vecOrigin, vecDirection, pfDistance, pnTriangle);
+    }
+    
+    bool bIsInside(const Vector3& vecPoint) const
+    {
+        return roBvh()->bIsInside(vecPoint);
+    }
+    
+    float fSignedDistance(const Vector3& vecPoint) const
+    {
+        // Requires a closed mesh for the sign
+        return roBvh()->fSignedDistance(vecPoint);
+    }
+    
+    // Batched versions of the queries above, run in parallel,
+    // outputs passed as nullptr are skipped
+    
+    void ClosestPoints( int32_t nPoints,
+                        const Vector3* pvecPoints,
+                        Vector3* pvecClosest,
+                        int32_t* pnTriangles,
+                        float* pfDistances) const
     {
-        Vector3 vec1(0,0,0);
-        Vector3 vec2(0,0,0);
-        Vector3 vec3(0,0,0);
+        MeshBvh::Ptr roTree = roBvh();
         
-        for (int32_t n=0; n<nTriangleCount(); n++)
+        tbb::parallel_for(  tbb::blocked_range<int32_t>(0, nPoints),
+                            [&](const tbb::blocked_range<int32_t>& oRange)
         {
-            GetTriangle(n, &vec1, &vec2, &vec3);
-            if (bIsPointInTriangle(vecSurfacePoint, vec1, vec2, vec3, pvecNormal))
-                return true;
-        }
+            for (int32_t n=oRange.begin(); n<oRange.end(); n++)
+            {
+                Vector3 vecClosest  = pvecPoints[n];
+                int32_t nTriangle   = -1;
+                float fDistance     = std::numeric_limits<float>::max();
+                
+                roTree->bClosestPoint(pvecPoints[n], &vecClosest, &nTriangle, &fDistance);
+                
+                if (pvecClosest != nullptr)
+                    pvecClosest[n] = vecClosest;
+                
+                if (pnTriangles != nullptr)
+                    pnTriangles[n] = nTriangle;
+                
+                if (pfDistances != nullptr)
+                    pfDistances[n] = fDistance;
+            }
+        });
+    }
+    
+    void RayCastBatch(  int32_t nRays,
+                        const Vector3* pvecOrigins,
+                        const Vector3* pvecDirections,
+                        bool* pbHits,
+                        Vector3* pvecHits,
+                        int32_t* pnTriangles,
+                        float* pfDistances) const
+    {
+        // Directions don't need to be normalized, distances are
+        // measured in units of the direction vector
+        
+        MeshBvh::Ptr roTree = roBvh();
+        
+        tbb::parallel_for(  tbb::blocked_range<int32_t>(0, nRays),
+                            [&](const tbb::blocked_range<int32_t>& oRange)
+        {
+            for (int32_t n=oRange.begin(); n<oRange.end(); n++)
+            {
+                int32_t nTriangle   = -1;
+                float fDistance     = std::numeric_limits<float>::max();
+                
+                bool bHit = roTree->bRayCast(   pvecOrigins[n],
+                                                pvecDirections[n],
+                                                &fDistance,
+                                                &nTriangle);
+                
+                if (pbHits != nullptr)
+                    pbHits[n] = bHit;
+                
+                if ((pvecHits != nullptr) && bHit)
+                    pvecHits[n] = pvecOrigins[n] + pvecDirections[n] * fDistance;
+                
+                if (pnTriangles != nullptr)
+                    pnTriangles[n] = nTriangle;
+                
+                if (pfDistances != nullptr)
+                    pfDistances[n] = fDistance;
+            }
+        });
+    }
+    
+    void GetNearestSurfaceNormals(  int32_t nPoints,
+                                    const Vector3* pvecPoints,
+                                    Vector3* pvecNormals) const
+    {
+        MeshBvh::Ptr roTree = roBvh();
+        
+        tbb::parallel_for(  tbb::blocked_range<int32_t>(0, nPoints),
+                            [&](const tbb::blocked_range<int32_t>& oRange)
+        {
+            for (int32_t n=oRange.begin(); n<oRange.end(); n++)
+            {
+                Vector3 vecClosest;
+                int32_t nTriangle;
+                float fDistance;
+                
+                pvecNormals[n] = roTree->bClosestPoint(pvecPoints[n], &vecClosest, &nTriangle, &fDistance) ?
+                                    roTree->vecTriangleNormal((uint32_t) nTriangle) :
+                                    Vector3(0.0f, 0.0f, 0.0f);
+            }
+        });
+    }
+    
+    void SignedDistances(   int32_t nPoints,
+                            const Vector3* pvecPoints,
+                            float* pfDistances) const
+    {
+        MeshBvh::Ptr roTree = roBvh();
+        
+        tbb::parallel_for(  tbb::blocked_range<int32_t>(0, nPoints),
+                            [&](const tbb::blocked_range<int32_t>& oRange)
+        {
+            for (int32_t n=oRange.begin(); n<oRange.end(); n++)
+                pfDistances[n] = roTree->fSignedDistance(pvecPoints[n]);
+        });
+    }
+    
+    MeshBvh::Ptr roBvh() const
+    {
+        // Built on first use, and dropped when triangles are added
+        
+        std::lock_guard<std::mutex> oLock(m_oBvhMutex);
+        
+        if (m_roBvh == nullptr)
+            m_roBvh = std::make_shared<MeshBvh>(m_oVertices, m_oTriangles);
         
-        return false;
+        return m_roBvh;
     }
     
 public:
     
+    void SetBuffers(    std::vector<Vector3>&& oVertices,
+                        std::vector<Triangle>&& oTriangles,
+                        const BBox3& oBBox)
+    {
+        // Takes over buffers that were built in bulk, the bounding box
+        // has to enclose all vertices
+        
+        assert(oVertices.size() < std::numeric_limits<int32_t>::max());
+        assert(oTriangles.size() < std::numeric_limits<int32_t>::max());
+        
+        m_oVertices     = std::move(oVertices);
+        m_oTriangles    = std::move(oTriangles);
+        m_oBBox         = oBBox;
+        m_roBvh.reset();
+    }
+    
     void* pVertexData() const
     {
         return (void*) m_oVertices.data();
@@ -156,32 +432,24 @@ public:
     }
     
 protected:
+    static int32_t nClampedCount(   int32_t nStart,
+                                    int32_t nCount,
+                                    int32_t nSize)
+    {
+        // Number of elements of [nStart, nStart+nCount) inside [0, nSize)
+        
+        if ((nStart < 0) || (nCount <= 0) || (nStart >= nSize))
+            return 0;
+        
+        return std::min(nCount, nSize - nStart);
+    }
+    
     BBox3                  m_oBBox;
     std::vector<Vector3>   m_oVertices;
     std::vector<Triangle>  m_oTriangles;
     
-    bool bIsPointInTriangle(    const Vector3& vecSurfacePoint,
-                                const Vector3& vecVertex1,
-                                const Vector3& vecVertex2,
-                                const Vector3& vecVertex3,
-                                Vector3* pvecNormal)
-    {
-        // Calculate the normal of the triangle
-        *pvecNormal = (vecVertex2 - vecVertex1).vecCross(vecVertex3 - vecVertex1);
-        pvecNormal->Normalize();
-
-        // Calculate the vectors from the point to each vertex of the triangle
-        Vector3 v0 = vecVertex1 - vecSurfacePoint;
-        Vector3 v1 = vecVertex2 - vecSurfacePoint;
-        Vector3 v2 = vecVertex3 - vecSurfacePoint;
-
-        // Calculate the dot products of these vectors with the triangle's normal
-        float dot01 = pvecNormal->fDot(v0.vecCross(v1));
-        float dot02 = pvecNormal->fDot(v0.vecCross(v2));
-
-        // If the dot products have the same sign, the point is inside the triangle
-        return (dot01 >= 0 && dot02 >= 0) || (dot01 <= 0 && dot02 <= 0);
-    }
+    mutable std::mutex          m_oBvhMutex;
+    mutable MeshBvh::Ptr        m_roBvh;
 };
 
 } // namespace PicoGK
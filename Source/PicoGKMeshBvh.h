@@ -0,0 +1,523 @@
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// PicoGK ("peacock") is a compact software kernel for computational geometry,
+// specifically for use in Computational Engineering Models (CEM).
+//
+// For more information, please visit https://picogk.org
+//
+// PicoGK is developed and maintained by LEAP 71 - © 2023-2024 by LEAP 71
+// https://leap71.com
+//
+// Computational Engineering will profoundly change our physical world in the
+// years ahead. Thank you for being part of the journey.
+//
+// We have developed this library to be used widely, for both commercial and
+// non-commercial projects alike. Therefore, have released it under a permissive
+// open-source license.
+//
+// The foundation of PicoGK is a thin layer on top of the powerful open-source
+// OpenVDB project, which in turn uses many other Free and Open Source Software
+// libraries. We are grateful to be able to stand on the shoulders of giants.
+//
+// LEAP 71 licenses this file to you under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with the
+// License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, THE SOFTWARE IS
+// PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#ifndef PICOGKMESHBVH_H_
+#define PICOGKMESHBVH_H_
+
+#include "PicoGKTypes.h"
+
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_invoke.h>
+#include <tbb/blocked_range.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+namespace PicoGK
+{
+
+class MeshBvh
+{
+public:
+    PKSHAREDPTR(MeshBvh);
+    
+    // Bounding volume hierarchy over the triangles of a mesh, split at the
+    // median centroid along the longest axis. The tree only stores triangle
+    // indices, the vertex and triangle vectors are referenced, so the
+    // hierarchy has to be rebuilt when they change
+    
+    MeshBvh(    const std::vector<Vector3>& oVertices,
+                const std::vector<Triangle>& oTriangles)
+    :   m_oVertices(oVertices),
+        m_oTriangles(oTriangles)
+    {
+        size_t nTriangles = oTriangles.size();
+        
+        if (nTriangles == 0)
+            return;
+        
+        m_oOrder.resize(nTriangles);
+        std::iota(m_oOrder.begin(), m_oOrder.end(), 0);
+        
+        std::vector<Vector3> oCentroids(nTriangles);
+        
+        tbb::parallel_for(  tbb::blocked_range<size_t>(0, nTriangles),
+                            [&](const tbb::blocked_range<size_t>& oRange)
+        {
+            for (size_t n=oRange.begin(); n<oRange.end(); n++)
+            {
+                const Triangle& sTri = oTriangles[n];
+                oCentroids[n] = (oVertices[sTri.A] + oVertices[sTri.B] + oVertices[sTri.C]) / 3.0f;
+            }
+        });
+        
+        m_oNodes.resize(nNodeCount(nTriangles));
+        Build(0, 0, nTriangles, oCentroids);
+    }
+    
+    bool bClosestPoint( const Vector3& vecPoint,
+                        Vector3* pvecClosest,
+                        int32_t* pnTriangle,
+                        float* pfDistance) const
+    {
+        if (m_oNodes.empty())
+            return false;
+        
+        float fBestSq = std::numeric_limits<float>::max();
+        
+        uint32_t anStack[nMaxDepth];
+        int32_t iTop = 0;
+        anStack[iTop++] = 0;
+        
+        while (iTop > 0)
+        {
+            const Node& oNode = m_oNodes[anStack[--iTop]];
+            
+            if (oNode.fDistanceSq(vecPoint) >= fBestSq)
+                continue;
+            
+            if (oNode.nCount > 0)
+            {
+                for (uint32_t n=oNode.nFirst; n<oNode.nFirst + oNode.nCount; n++)
+                {
+                    uint32_t nTri = m_oOrder[n];
+                    Vector3 vecClosest = vecClosestOnTriangle(vecPoint, nTri);
+                    float fDistSq = (vecClosest - vecPoint).fLengthSquared();
+                    
+                    if (fDistSq < fBestSq)
+                    {
+                        fBestSq         = fDistSq;
+                        *pvecClosest    = vecClosest;
+                        *pnTriangle     = (int32_t) nTri;
+                    }
+                }
+                
+                continue;
+            }
+            
+            // Visit the nearer child first, so it is pushed last
+            
+            uint32_t nLeft  = (uint32_t) (&oNode - m_oNodes.data()) + 1;
+            uint32_t nRight = oNode.nFirst;
+            
+            if (m_oNodes[nLeft].fDistanceSq(vecPoint) < m_oNodes[nRight].fDistanceSq(vecPoint))
+                std::swap(nLeft, nRight);
+            
+            anStack[iTop++] = nLeft;
+            anStack[iTop++] = nRight;
+        }
+        
+        *pfDistance = std::sqrt(fBestSq);
+        return true;
+    }
+    
+    bool bRayCast(  const Vector3& vecOrigin,
+                    const Vector3& vecDirection,
+                    float* pfDistance,
+                    int32_t* pnTriangle) const
+    {
+        // Nearest hit along the ray, from either side of the triangles,
+        // the distance is in units of vecDirection
+        
+        float fBest = std::numeric_limits<float>::max();
+        bool bHit   = false;
+        
+        Traverse(   vecOrigin,
+                    vecDirection,
+                    &fBest,
+                    [&](uint32_t nTri, float fT)
+        {
+            if (fT < fBest)
+            {
+                fBest       = fT;
+                *pnTriangle = (int32_t) nTri;
+                bHit        = true;
+            }
+        });
+        
+        *pfDistance = fBest;
+        return bHit;
+    }
+    
+    bool bIsInside(const Vector3& vecPoint) const
+    {
+        // Majority vote over the crossing parity of three rays, so a ray
+        // grazing an edge or vertex doesn't decide the result alone.
+        // Requires a closed mesh
+        
+        static const Vector3 avecDirections[3] =
+        {
+            Vector3( 1.0f,      0.3713f,    0.1537f),
+            Vector3(-0.2431f,   1.0f,       0.4417f),
+            Vector3( 0.1319f,  -0.3719f,    1.0f)
+        };
+        
+        int nInside = 0;
+        
+        for (const Vector3& vecDir : avecDirections)
+        {
+            float fMax = std::numeric_limits<float>::max();
+            int nCrossings = 0;
+            
+            Traverse(   vecPoint,
+                        vecDir,
+                        &fMax,
+                        [&](uint32_t, float)
+            {
+                nCrossings++;
+            });
+            
+            nInside += (nCrossings & 1);
+        }
+        
+        return nInside >= 2;
+    }
+    
+    float fSignedDistance(const Vector3& vecPoint) const
+    {
+        // Exact distance to the surface, negative inside
+        
+        Vector3 vecClosest;
+        int32_t nTriangle;
+        float fDistance;
+        
+        if (!bClosestPoint(vecPoint, &vecClosest, &nTriangle, &fDistance))
+            return std::numeric_limits<float>::max();
+        
+        return bIsInside(vecPoint) ? -fDistance : fDistance;
+    }
+    
+    Vector3 vecTriangleNormal(uint32_t nTriangle) const
+    {
+        const Triangle& sTri = m_oTriangles[nTriangle];
+        const Vector3& vecA = m_oVertices[sTri.A];
+        
+        Vector3 vecN = (m_oVertices[sTri.B] - vecA).vecCross(m_oVertices[sTri.C] - vecA);
+        vecN.Normalize();
+        return vecN;
+    }
+    
+protected:
+    static constexpr uint32_t nLeafSize = 4;
+    static constexpr int32_t  nMaxDepth = 128;
+    
+    class Node
+    {
+    public:
+        Vector3     vecMin;
+        Vector3     vecMax;
+        uint32_t    nFirst;     // leaf: first entry in m_oOrder, inner node: right child
+        uint32_t    nCount;     // leaf: number of triangles, inner node: 0
+        
+        float fDistanceSq(const Vector3& vec) const
+        {
+            float fSq = 0.0f;
+            
+            for (int n=0; n<3; n++)
+            {
+                float f = std::max(std::max(vecMin.v[n] - vec.v[n], vec.v[n] - vecMax.v[n]), 0.0f);
+                fSq += f * f;
+            }
+            
+            return fSq;
+        }
+        
+        bool bRayHit(   const Vector3& vecOrigin,
+                        const Vector3& vecInvDir,
+                        float fMax) const
+        {
+            float fNear = 0.0f;
+            float fFar  = fMax;
+            
+            for (int n=0; n<3; n++)
+            {
+                float f1 = (vecMin.v[n] - vecOrigin.v[n]) * vecInvDir.v[n];
+                float f2 = (vecMax.v[n] - vecOrigin.v[n]) * vecInvDir.v[n];
+                
+                fNear   = std::max(fNear, std::min(f1, f2));
+                fFar    = std::min(fFar,  std::max(f1, f2));
+            }
+            
+            return fNear <= fFar;
+        }
+    };
+    
+    static size_t nNodeCount(size_t nTriangles)
+    {
+        // The sizes on one level of the tree differ by at most one, so each
+        // level is described by the smaller size and how often both occur
+        
+        size_t nTotal   = 0;
+        size_t nSize    = nTriangles;
+        size_t anCount[2] = {1, 0};
+        
+        while (anCount[0] + anCount[1] > 0)
+        {
+            nTotal += anCount[0] + anCount[1];
+            
+            size_t nNext = nSize / 2;
+            size_t anNext[2] = {0, 0};
+            
+            for (size_t n=0; n<2; n++)
+            {
+                size_t nSplit = nSize + n;
+                
+                if ((anCount[n] == 0) || (nSplit <= nLeafSize))
+                    continue;
+                
+                anNext[nSplit / 2 - nNext]              += anCount[n];
+                anNext[nSplit - nSplit / 2 - nNext]     += anCount[n];
+            }
+            
+            nSize       = nNext;
+            anCount[0]  = anNext[0];
+            anCount[1]  = anNext[1];
+        }
+        
+        return nTotal;
+    }
+    
+    void Build( size_t nNode,
+                size_t nBegin,
+                size_t nEnd,
+                const std::vector<Vector3>& oCentroids)
+    {
+        // Child nodes are placed depth first, the left child directly
+        // after its parent, so both subtrees can be built in parallel
+        
+        Node& oNode = m_oNodes[nNode];
+        
+        BBox3 oBounds;
+        BBox3 oCentroidBounds;
+        
+        for (size_t n=nBegin; n<nEnd; n++)
+        {
+            const Triangle& sTri = m_oTriangles[m_oOrder[n]];
+            oBounds.Include(m_oVertices[sTri.A]);
+            oBounds.Include(m_oVertices[sTri.B]);
+            oBounds.Include(m_oVertices[sTri.C]);
+            oCentroidBounds.Include(oCentroids[m_oOrder[n]]);
+        }
+        
+        oNode.vecMin = oBounds.vecMin;
+        oNode.vecMax = oBounds.vecMax;
+        
+        size_t nCount = nEnd - nBegin;
+        
+        if (nCount <= nLeafSize)
+        {
+            oNode.nFirst = (uint32_t) nBegin;
+            oNode.nCount = (uint32_t) nCount;
+            return;
+        }
+        
+        Vector3 vecSize = oCentroidBounds.vecMax - oCentroidBounds.vecMin;
+        int nAxis = 0;
+        if (vecSize.Y > vecSize.v[nAxis]) nAxis = 1;
+        if (vecSize.Z > vecSize.v[nAxis]) nAxis = 2;
+        
+        size_t nMid = nBegin + nCount / 2;
+        
+        std::nth_element(   m_oOrder.begin() + nBegin,
+                            m_oOrder.begin() + nMid,
+                            m_oOrder.begin() + nEnd,
+                            [&](uint32_t nA, uint32_t nB)
+                            {
+                                return oCentroids[nA].v[nAxis] < oCentroids[nB].v[nAxis];
+                            });
+        
+        size_t nLeft    = nNode + 1;
+        size_t nRight   = nLeft + nNodeCount(nMid - nBegin);
+        
+        oNode.nFirst = (uint32_t) nRight;
+        oNode.nCount = 0;
+        
+        if (nCount < 16384)
+        {
+            Build(nLeft,  nBegin, nMid, oCentroids);
+            Build(nRight, nMid,   nEnd, oCentroids);
+            return;
+        }
+        
+        tbb::parallel_invoke(   [&] {Build(nLeft,  nBegin, nMid, oCentroids);},
+                                [&] {Build(nRight, nMid,   nEnd, oCentroids);});
+    }
+    
+    template <class TFnHit>
+    void Traverse(  const Vector3& vecOrigin,
+                    const Vector3& vecDirection,
+                    const float* pfMax,
+                    const TFnHit& fnHit) const
+    {
+        // Calls fnHit(nTriangle, fT) for every triangle the ray hits,
+        // *pfMax is re-read, so fnHit can shorten the ray
+        
+        if (m_oNodes.empty())
+            return;
+        
+        Vector3 vecInvDir(  1.0f / vecDirection.X,
+                            1.0f / vecDirection.Y,
+                            1.0f / vecDirection.Z);
+        
+        uint32_t anStack[nMaxDepth];
+        int32_t iTop = 0;
+        anStack[iTop++] = 0;
+        
+        while (iTop > 0)
+        {
+            uint32_t nNode      = anStack[--iTop];
+            const Node& oNode   = m_oNodes[nNode];
+            
+            if (!oNode.bRayHit(vecOrigin, vecInvDir, *pfMax))
+                continue;
+            
+            if (oNode.nCount == 0)
+            {
+                anStack[iTop++] = oNode.nFirst;
+                anStack[iTop++] = nNode + 1;
+                continue;
+            }
+            
+            for (uint32_t n=oNode.nFirst; n<oNode.nFirst + oNode.nCount; n++)
+            {
+                float fT;
+                if (bRayTriangle(vecOrigin, vecDirection, m_oOrder[n], &fT) && (fT <= *pfMax))
+                    fnHit(m_oOrder[n], fT);
+            }
+        }
+    }
+    
+    bool bRayTriangle(  const Vector3& vecOrigin,
+                        const Vector3& vecDirection,
+                        uint32_t nTriangle,
+                        float* pfT) const
+    {
+        // Möller-Trumbore, hits from both sides count
+        
+        const Triangle& sTri = m_oTriangles[nTriangle];
+        const Vector3& vecA = m_oVertices[sTri.A];
+        
+        Vector3 vecE1 = m_oVertices[sTri.B] - vecA;
+        Vector3 vecE2 = m_oVertices[sTri.C] - vecA;
+        Vector3 vecP  = vecDirection.vecCross(vecE2);
+        
+        float fDet = vecE1.fDot(vecP);
+        if (fDet == 0.0f)
+            return false;
+        
+        float fInvDet = 1.0f / fDet;
+        
+        Vector3 vecS = vecOrigin - vecA;
+        float fU = vecS.fDot(vecP) * fInvDet;
+        if ((fU < 0.0f) || (fU > 1.0f))
+            return false;
+        
+        Vector3 vecQ = vecS.vecCross(vecE1);
+        float fV = vecDirection.fDot(vecQ) * fInvDet;
+        if ((fV < 0.0f) || (fU + fV > 1.0f))
+            return false;
+        
+        *pfT = vecE2.fDot(vecQ) * fInvDet;
+        return *pfT >= 0.0f;
+    }
+    
+    Vector3 vecClosestOnTriangle(   const Vector3& vecP,
+                                    uint32_t nTriangle) const
+    {
+        // Closest point by Voronoi region of the triangle
+        // (Ericson, Real-Time Collision Detection, 5.1.5)
+        
+        const Triangle& sTri = m_oTriangles[nTriangle];
+        const Vector3& vecA = m_oVertices[sTri.A];
+        const Vector3& vecB = m_oVertices[sTri.B];
+        const Vector3& vecC = m_oVertices[sTri.C];
+        
+        Vector3 vecAB = vecB - vecA;
+        Vector3 vecAC = vecC - vecA;
+        Vector3 vecAP = vecP - vecA;
+        
+        float d1 = vecAB.fDot(vecAP);
+        float d2 = vecAC.fDot(vecAP);
+        if ((d1 <= 0.0f) && (d2 <= 0.0f))
+            return vecA;
+        
+        Vector3 vecBP = vecP - vecB;
+        float d3 = vecAB.fDot(vecBP);
+        float d4 = vecAC.fDot(vecBP);
+        if ((d3 >= 0.0f) && (d4 <= d3))
+            return vecB;
+        
+        float vc = d1 * d4 - d3 * d2;
+        if ((vc <= 0.0f) && (d1 >= 0.0f) && (d3 <= 0.0f))
+            return vecA + vecAB * (d1 / (d1 - d3));
+        
+        Vector3 vecCP = vecP - vecC;
+        float d5 = vecAB.fDot(vecCP);
+        float d6 = vecAC.fDot(vecCP);
+        if ((d6 >= 0.0f) && (d5 <= d6))
+            return vecC;
+        
+        float vb = d5 * d2 - d1 * d6;
+        if ((vb <= 0.0f) && (d2 >= 0.0f) && (d6 <= 0.0f))
+            return vecA + vecAC * (d2 / (d2 - d6));
+        
+        float va = d3 * d6 - d5 * d4;
+        if ((va <= 0.0f) && ((d4 - d3) >= 0.0f) && ((d5 - d6) >= 0.0f))
+            return vecB + (vecC - vecB) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+        
+        float fDenom = va + vb + vc;
+        if (fDenom == 0.0f)
+            return vecA; // degenerate triangle
+        
+        float v = vb / fDenom;
+        float w = vc / fDenom;
+        return vecA + vecAB * v + vecAC * w;
+    }
+    
+    const std::vector<Vector3>&     m_oVertices;
+    const std::vector<Triangle>&    m_oTriangles;
+    std::vector<uint32_t>           m_oOrder;
+    std::vector<Node>               m_oNodes;
+};
+
+} // namespace PicoGK
+
+#endif // PICOGKMESHBVH_H_
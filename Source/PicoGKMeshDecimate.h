@@ -0,0 +1,578 @@
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// PicoGK ("peacock") is a compact software kernel for computational geometry,
+// specifically for use in Computational Engineering Models (CEM).
+//
+// For more information, please visit https://picogk.org
+//
+// PicoGK is developed and maintained by LEAP 71 - © 2023-2024 by LEAP 71
+// https://leap71.com
+//
+// Computational Engineering will profoundly change our physical world in the
+// years ahead. Thank you for being part of the journey.
+//
+// We have developed this library to be used widely, for both commercial and
+// non-commercial projects alike. Therefore, have released it under a permissive
+// open-source license.
+//
+// The foundation of PicoGK is a thin layer on top of the powerful open-source
+// OpenVDB project, which in turn uses many other Free and Open Source Software
+// libraries. We are grateful to be able to stand on the shoulders of giants.
+//
+// LEAP 71 licenses this file to you under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with the
+// License. You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, THE SOFTWARE IS
+// PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED.
+//
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#ifndef PICOGKMESHDECIMATE_H_
+#define PICOGKMESHDECIMATE_H_
+
+#include "PicoGKMesh.h"
+
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
+#include <tbb/blocked_range.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+namespace PicoGK
+{
+
+class MeshDecimator
+{
+public:
+    // Quadric error edge collapse, run in rounds. Each round evaluates all
+    // edges in parallel, greedily picks the cheapest collapses whose
+    // neighborhoods don't overlap, and applies them in parallel.
+    //
+    // Stops when the mesh has nTargetTriangles or fewer triangles, or when
+    // no collapse stays within fMaxDeviationMM of the planes of the original
+    // triangles it replaces (the summed squared distances are bounded, which
+    // is conservative). Pass 0 to disable either criterion.
+    // Boundary and non-manifold edges are kept as they are
+    
+    static void Decimate(   Mesh& oMesh,
+                            int32_t nTargetTriangles,
+                            float fMaxDeviationMM)
+    {
+        if ((nTargetTriangles <= 0) && (fMaxDeviationMM <= 0.0f))
+            return;
+        
+        MeshDecimator oDecimator(oMesh);
+        
+        oDecimator.Run( (nTargetTriangles > 0) ? (size_t) nTargetTriangles : 0,
+                        (fMaxDeviationMM > 0.0f) ?  (double) fMaxDeviationMM * fMaxDeviationMM :
+                                                    std::numeric_limits<double>::max());
+        
+        oDecimator.Store(&oMesh);
+    }
+    
+protected:
+    class Quadric
+    {
+    public:
+        Quadric()
+        {
+            for (int n=0; n<10; n++)
+                a[n] = 0.0;
+        }
+        
+        void AddPlane(  double dX,
+                        double dY,
+                        double dZ,
+                        double dD)
+        {
+            a[0] += dX * dX;    a[1] += dX * dY;    a[2] += dX * dZ;    a[3] += dX * dD;
+                                a[4] += dY * dY;    a[5] += dY * dZ;    a[6] += dY * dD;
+                                                    a[7] += dZ * dZ;    a[8] += dZ * dD;
+                                                                        a[9] += dD * dD;
+        }
+        
+        void operator+=(const Quadric& oQ)
+        {
+            for (int n=0; n<10; n++)
+                a[n] += oQ.a[n];
+        }
+        
+        double dError(const Vector3& vec) const
+        {
+            double x = vec.X;
+            double y = vec.Y;
+            double z = vec.Z;
+            
+            double d =      a[0] * x * x + 2.0 * (a[1] * x * y + a[2] * x * z + a[3] * x)
+                        +   a[4] * y * y + 2.0 * (a[5] * y * z + a[6] * y)
+                        +   a[7] * z * z + 2.0 *  a[8] * z
+                        +   a[9];
+            
+            return std::max(0.0, d);
+        }
+        
+        bool bMinimum(Vector3* pvec) const
+        {
+            // Solves A v = -b for the symmetric 3x3 part of the quadric,
+            // fails if the matrix is close to singular (flat regions)
+            
+            double i00 = a[4] * a[7] - a[5] * a[5];
+            double i01 = a[2] * a[5] - a[1] * a[7];
+            double i02 = a[1] * a[5] - a[2] * a[4];
+            double i11 = a[0] * a[7] - a[2] * a[2];
+            double i12 = a[1] * a[2] - a[0] * a[5];
+            double i22 = a[0] * a[4] - a[1] * a[1];
+            
+            double dDet     = a[0] * i00 + a[1] * i01 + a[2] * i02;
+            double dTrace   = (a[0] + a[4] + a[7]) / 3.0;
+            
+            if (std::abs(dDet) <= 1e-6 * dTrace * dTrace * dTrace)
+                return false;
+            
+            *pvec = Vector3(    (float) (-(i00 * a[3] + i01 * a[6] + i02 * a[8]) / dDet),
+                                (float) (-(i01 * a[3] + i11 * a[6] + i12 * a[8]) / dDet),
+                                (float) (-(i02 * a[3] + i12 * a[6] + i22 * a[8]) / dDet));
+            return true;
+        }
+        
+        double a[10];
+    };
+    
+    class Collapse
+    {
+    public:
+        double      dCost;
+        uint32_t    nKeep;
+        uint32_t    nRemove;
+        Vector3     vecPos;
+    };
+    
+    MeshDecimator(const Mesh& oMesh)
+    {
+        const Vector3*  pvecVertices    = (const Vector3*) oMesh.pVertexData();
+        const Triangle* psTriangles     = (const Triangle*) oMesh.pTriangleData();
+        
+        m_oVertices.assign(pvecVertices, pvecVertices + oMesh.nVertexCount());
+        m_oTriangles.reserve(oMesh.nTriangleCount());
+        
+        for (int32_t n=0; n<oMesh.nTriangleCount(); n++)
+        {
+            if (!bDegenerate(psTriangles[n]))
+                m_oTriangles.push_back(psTriangles[n]);
+        }
+    }
+    
+    void Run(   size_t nTargetTriangles,
+                double dMaxError)
+    {
+        BuildAdjacency();
+        InitQuadrics();
+        
+        m_oRemap.resize(m_oVertices.size());
+        for (size_t n=0; n<m_oRemap.size(); n++)
+            m_oRemap[n] = (uint32_t) n;
+        
+        while (m_oTriangles.size() > nTargetTriangles)
+        {
+            if (nCollapseRound(nTargetTriangles, dMaxError) == 0)
+                break;
+        }
+    }
+    
+    void Store(Mesh* poMesh) const
+    {
+        // Drops the vertices that are no longer referenced
+        
+        std::vector<uint32_t> oNewIndex(m_oVertices.size(), UINT32_MAX);
+        std::vector<Vector3> oVertices;
+        BBox3 oBBox;
+        
+        std::vector<Triangle> oTriangles(m_oTriangles);
+        
+        for (Triangle& sTri : oTriangles)
+        {
+            for (int n=0; n<3; n++)
+            {
+                int32_t& nVertex = (n == 0) ? sTri.A : (n == 1) ? sTri.B : sTri.C;
+                
+                if (oNewIndex[nVertex] == UINT32_MAX)
+                {
+                    oNewIndex[nVertex] = (uint32_t) oVertices.size();
+                    oVertices.push_back(m_oVertices[nVertex]);
+                    oBBox.Include(m_oVertices[nVertex]);
+                }
+                
+                nVertex = (int32_t) oNewIndex[nVertex];
+            }
+        }
+        
+        poMesh->SetBuffers(std::move(oVertices), std::move(oTriangles), oBBox);
+    }
+    
+    static bool bDegenerate(const Triangle& sTri)
+    {
+        return (sTri.A == sTri.B) || (sTri.B == sTri.C) || (sTri.C == sTri.A);
+    }
+    
+    static uint32_t nCorner(const Triangle& sTri, int n)
+    {
+        return (uint32_t) ((n == 0) ? sTri.A : (n == 1) ? sTri.B : sTri.C);
+    }
+    
+    void BuildAdjacency()
+    {
+        // Triangles around each vertex, in compressed row form
+        
+        size_t nVertices = m_oVertices.size();
+        
+        m_oFirstTriangle.assign(nVertices + 1, 0);
+        
+        for (const Triangle& sTri : m_oTriangles)
+        {
+            for (int n=0; n<3; n++)
+                m_oFirstTriangle[nCorner(sTri, n) + 1]++;
+        }
+        
+        for (size_t n=0; n<nVertices; n++)
+            m_oFirstTriangle[n+1] += m_oFirstTriangle[n];
+        
+        m_oVertexTriangles.resize(m_oFirstTriangle[nVertices]);
+        
+        std::vector<uint32_t> oFill(m_oFirstTriangle.begin(), m_oFirstTriangle.end() - 1);
+        
+        for (size_t nTri=0; nTri<m_oTriangles.size(); nTri++)
+        {
+            for (int n=0; n<3; n++)
+                m_oVertexTriangles[oFill[nCorner(m_oTriangles[nTri], n)]++] = (uint32_t) nTri;
+        }
+    }
+    
+    void InitQuadrics()
+    {
+        // Each vertex starts with the planes of its triangles
+        
+        m_oQuadrics.resize(m_oVertices.size());
+        
+        tbb::parallel_for(  tbb::blocked_range<size_t>(0, m_oVertices.size()),
+                            [&](const tbb::blocked_range<size_t>& oRange)
+        {
+            for (size_t nVertex=oRange.begin(); nVertex<oRange.end(); nVertex++)
+            {
+                Quadric oQ;
+                
+                for (uint32_t n=m_oFirstTriangle[nVertex]; n<m_oFirstTriangle[nVertex+1]; n++)
+                {
+                    const Triangle& sTri = m_oTriangles[m_oVertexTriangles[n]];
+                    
+                    const Vector3& vecA = m_oVertices[sTri.A];
+                    Vector3 vecN = (m_oVertices[sTri.B] - vecA).vecCross(m_oVertices[sTri.C] - vecA);
+                    
+                    double dLength = vecN.fLength();
+                    if (dLength <= 0.0)
+                        continue;
+                    
+                    double dX = vecN.X / dLength;
+                    double dY = vecN.Y / dLength;
+                    double dZ = vecN.Z / dLength;
+                    
+                    oQ.AddPlane(dX, dY, dZ, -(dX * vecA.X + dY * vecA.Y + dZ * vecA.Z));
+                }
+                
+                m_oQuadrics[nVertex] = oQ;
+            }
+        });
+    }
+    
+    void GetRing(   uint32_t nVertex,
+                    std::vector<uint32_t>* poRing) const
+    {
+        // Sorted unique neighbors of the vertex
+        
+        poRing->clear();
+        
+        for (uint32_t n=m_oFirstTriangle[nVertex]; n<m_oFirstTriangle[nVertex+1]; n++)
+        {
+            const Triangle& sTri = m_oTriangles[m_oVertexTriangles[n]];
+            
+            for (int nC=0; nC<3; nC++)
+            {
+                if (nCorner(sTri, nC) != nVertex)
+                    poRing->push_back(nCorner(sTri, nC));
+            }
+        }
+        
+        std::sort(poRing->begin(), poRing->end());
+        poRing->erase(std::unique(poRing->begin(), poRing->end()), poRing->end());
+    }
+    
+    bool bFlipsTriangles(   uint32_t nVertex,
+                            uint32_t nOther,
+                            const Vector3& vecPos) const
+    {
+        // True, if moving nVertex to vecPos turns over or collapses one of
+        // its triangles, ignoring those shared with nOther, which vanish
+        
+        for (uint32_t n=m_oFirstTriangle[nVertex]; n<m_oFirstTriangle[nVertex+1]; n++)
+        {
+            const Triangle& sTri = m_oTriangles[m_oVertexTriangles[n]];
+            
+            Vector3 avec[3] = { m_oVertices[sTri.A],
+                                m_oVertices[sTri.B],
+                                m_oVertices[sTri.C]};
+            
+            Vector3 vecOld = (avec[1] - avec[0]).vecCross(avec[2] - avec[0]);
+            
+            bool bShared = false;
+            for (int nC=0; nC<3; nC++)
+            {
+                if (nCorner(sTri, nC) == nOther)
+                    bShared = true;
+                else if (nCorner(sTri, nC) == nVertex)
+                    avec[nC] = vecPos;
+            }
+            
+            if (bShared)
+                continue;
+            
+            Vector3 vecNew = (avec[1] - avec[0]).vecCross(avec[2] - avec[0]);
+            
+            if (vecNew.fDot(vecOld) <= 0.2f * vecNew.fLength() * vecOld.fLength())
+                return true;
+        }
+        
+        return false;
+    }
+    
+    size_t nCollapseRound(  size_t nTargetTriangles,
+                            double dMaxError)
+    {
+        size_t nVertices = m_oVertices.size();
+        
+        // All half edges, sorted, so that the number of triangles
+        // sharing an edge can be counted
+        
+        std::vector<uint64_t> oHalfEdges(m_oTriangles.size() * 3);
+        
+        tbb::parallel_for(  tbb::blocked_range<size_t>(0, m_oTriangles.size()),
+                            [&](const tbb::blocked_range<size_t>& oRange)
+        {
+            for (size_t nTri=oRange.begin(); nTri<oRange.end(); nTri++)
+            {
+                for (int n=0; n<3; n++)
+                {
+                    uint64_t nA = nCorner(m_oTriangles[nTri], n);
+                    uint64_t nB = nCorner(m_oTriangles[nTri], (n + 1) % 3);
+                    oHalfEdges[nTri * 3 + n] = (std::min(nA, nB) << 32) | std::max(nA, nB);
+                }
+            }
+        });
+        
+        tbb::parallel_sort(oHalfEdges.begin(), oHalfEdges.end());
+        
+        // Vertices on boundary or non-manifold edges are locked
+        
+        std::vector<uint8_t> oLocked(nVertices, 0);
+        std::vector<uint64_t> oEdges;
+        oEdges.reserve(oHalfEdges.size() / 2);
+        
+        for (size_t n=0; n<oHalfEdges.size();)
+        {
+            size_t nEnd = n + 1;
+            while ((nEnd < oHalfEdges.size()) && (oHalfEdges[nEnd] == oHalfEdges[n]))
+                nEnd++;
+            
+            if (nEnd - n != 2)
+            {
+                oLocked[oHalfEdges[n] >> 32]        = 1;
+                oLocked[oHalfEdges[n] & 0xFFFFFFFF] = 1;
+            }
+            
+            oEdges.push_back(oHalfEdges[n]);
+            n = nEnd;
+        }
+        
+        oHalfEdges = std::vector<uint64_t>();
+        
+        // Evaluate all collapses in parallel
+        
+        std::vector<Collapse> oCollapses(oEdges.size());
+        
+        tbb::parallel_for(  tbb::blocked_range<size_t>(0, oEdges.size()),
+                            [&](const tbb::blocked_range<size_t>& oRange)
+        {
+            std::vector<uint32_t> oRingA;
+            std::vector<uint32_t> oRingB;
+            
+            for (size_t nEdge=oRange.begin(); nEdge<oRange.end(); nEdge++)
+            {
+                Collapse& oC    = oCollapses[nEdge];
+                oC.nKeep        = (uint32_t) (oEdges[nEdge] >> 32);
+                oC.nRemove      = (uint32_t) (oEdges[nEdge] & 0xFFFFFFFF);
+                oC.dCost        = std::numeric_limits<double>::max();
+                
+                if (oLocked[oC.nKeep] || oLocked[oC.nRemove])
+                    continue;
+                
+                Quadric oQ = m_oQuadrics[oC.nKeep];
+                oQ += m_oQuadrics[oC.nRemove];
+                
+                const Vector3& vecA = m_oVertices[oC.nKeep];
+                const Vector3& vecB = m_oVertices[oC.nRemove];
+                Vector3 vecMid      = (vecA + vecB) * 0.5f;
+                
+                // Use the optimal position, unless it lies far from the edge,
+                // otherwise the best of the end points and the midpoint
+                
+                Vector3 vecPos = vecMid;
+                if (    !oQ.bMinimum(&vecPos) ||
+                        ((vecPos - vecMid).fLength() > (vecB - vecA).fLength()))
+                {
+                    vecPos = vecMid;
+                    
+                    if (oQ.dError(vecA) < oQ.dError(vecPos))
+                        vecPos = vecA;
+                    
+                    if (oQ.dError(vecB) < oQ.dError(vecPos))
+                        vecPos = vecB;
+                }
+                
+                double dCost = oQ.dError(vecPos);
+                if (dCost > dMaxError)
+                    continue;
+                
+                // Link condition, the edge has to be shared by exactly two
+                // triangles whose third vertices are the only common neighbors
+                
+                GetRing(oC.nKeep, &oRingA);
+                GetRing(oC.nRemove, &oRingB);
+                
+                size_t nCommon = 0;
+                for (size_t nA=0, nB=0; (nA < oRingA.size()) && (nB < oRingB.size());)
+                {
+                    if (oRingA[nA] < oRingB[nB])
+                        nA++;
+                    else if (oRingB[nB] < oRingA[nA])
+                        nB++;
+                    else
+                    {
+                        nCommon++;
+                        nA++;
+                        nB++;
+                    }
+                }
+                
+                if (nCommon != 2)
+                    continue;
+                
+                if (    bFlipsTriangles(oC.nKeep, oC.nRemove, vecPos) ||
+                        bFlipsTriangles(oC.nRemove, oC.nKeep, vecPos))
+                    continue;
+                
+                oC.dCost    = dCost;
+                oC.vecPos   = vecPos;
+            }
+        });
+        
+        oCollapses.erase(   std::remove_if( oCollapses.begin(),
+                                            oCollapses.end(),
+                                            [](const Collapse& oC) {return oC.dCost == std::numeric_limits<double>::max();}),
+                            oCollapses.end());
+        
+        tbb::parallel_sort( oCollapses.begin(),
+                            oCollapses.end(),
+                            [](const Collapse& oA, const Collapse& oB) {return oA.dCost < oB.dCost;});
+        
+        // Greedily pick the cheapest collapses, skipping those whose end
+        // points are in the one-ring of an edge picked earlier. Neighborhood
+        // is symmetric, so no two picked collapses share a triangle and all
+        // can be applied at once with the costs computed above
+        
+        std::vector<uint8_t> oTouched(nVertices, 0);
+        std::vector<Collapse> oSelected;
+        std::vector<uint32_t> oRing;
+        
+        size_t nTriangles = m_oTriangles.size();
+        
+        for (const Collapse& oC : oCollapses)
+        {
+            if (nTriangles <= nTargetTriangles)
+                break;
+            
+            if (oTouched[oC.nKeep] || oTouched[oC.nRemove])
+                continue;
+            
+            for (uint32_t nVertex : {oC.nKeep, oC.nRemove})
+            {
+                oTouched[nVertex] = 1;
+                
+                GetRing(nVertex, &oRing);
+                for (uint32_t nRing : oRing)
+                    oTouched[nRing] = 1;
+            }
+            
+            oSelected.push_back(oC);
+            nTriangles -= 2;
+        }
+        
+        if (oSelected.empty())
+            return 0;
+        
+        // Apply the collapses, then drop the triangles that degenerated
+        
+        tbb::parallel_for(  tbb::blocked_range<size_t>(0, oSelected.size()),
+                            [&](const tbb::blocked_range<size_t>& oRange)
+        {
+            for (size_t n=oRange.begin(); n<oRange.end(); n++)
+            {
+                const Collapse& oC = oSelected[n];
+                
+                m_oVertices[oC.nKeep]   = oC.vecPos;
+                m_oQuadrics[oC.nKeep]   += m_oQuadrics[oC.nRemove];
+                m_oRemap[oC.nRemove]    = oC.nKeep;
+            }
+        });
+        
+        tbb::parallel_for(  tbb::blocked_range<size_t>(0, m_oTriangles.size()),
+                            [&](const tbb::blocked_range<size_t>& oRange)
+        {
+            for (size_t n=oRange.begin(); n<oRange.end(); n++)
+            {
+                Triangle& sTri = m_oTriangles[n];
+                sTri = Triangle(    (int32_t) m_oRemap[sTri.A],
+                                    (int32_t) m_oRemap[sTri.B],
+                                    (int32_t) m_oRemap[sTri.C]);
+            }
+        });
+        
+        m_oTriangles.erase( std::remove_if(m_oTriangles.begin(), m_oTriangles.end(), bDegenerate),
+                            m_oTriangles.end());
+        
+        for (const Collapse& oC : oSelected)
+            m_oRemap[oC.nRemove] = oC.nRemove;
+        
+        BuildAdjacency();
+        return oSelected.size();
+    }
+    
+    std::vector<Vector3>    m_oVertices;
+    std::vector<Triangle>   m_oTriangles;
+    std::vector<Quadric>    m_oQuadrics;
+    std::vector<uint32_t>   m_oRemap;
+    std::vector<uint32_t>   m_oFirstTriangle;
+    std::vector<uint32_t>   m_oVertexTriangles;
+};
+
+} // namespace PicoGK
+
+#endif // PICOGKMESHDECIMATE_H_
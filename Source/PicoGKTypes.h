@@ -128,6 +128,15 @@ struct Vector2
 
 struct Vector3
 {
+    Vector3()
+    {
+#ifdef _DEBUG
+        X = std::numeric_limits<float>::quiet_NaN();
+        Y = std::numeric_limits<float>::quiet_NaN();
+        Z = std::numeric_limits<float>::quiet_NaN();
+#endif
+    }
+    
     Vector3(    float fX,
                 float fY,
                 float fZ)
@@ -347,7 +356,7 @@ struct BBox3
         for (int n=0;n<3;n++)
         {
             vecMin.v[n] = std::min<float>(oBB.vecMin.v[n], vecMin.v[n]);
-            vecMax.v[n] = std::min<float>(oBB.vecMax.v[n], vecMax.v[n]);
+            vecMax.v[n] = std::max<float>(oBB.vecMax.v[n], vecMax.v[n]);
         }
     }
     
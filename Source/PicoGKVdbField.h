@@ -104,7 +104,7 @@ public:
     {
         auto oField     = m_roGrid->getAccessor();
         auto oVoxels    = roVoxels->roVdbGrid()->getConstAccessor();
-        CoordBBox oBBox = roVoxels->roVdbGrid()->evalActiveVoxelBoundingBox();
+        CoordBBox oBBox = roVoxels->oActiveBBox();
         
         for (auto x=oBBox.min().x(); x<=oBBox.max().x(); x++)
         for (auto y=oBBox.min().y(); y<=oBBox.max().y(); y++)
@@ -231,7 +231,7 @@ public:
     {
         auto oField     = m_roGrid->getAccessor();
         auto oVoxels    = roVoxels->roVdbGrid()->getConstAccessor();
-        CoordBBox oBBox = roVoxels->roVdbGrid()->evalActiveVoxelBoundingBox();
+        CoordBBox oBBox = roVoxels->oActiveBBox();
         
         math::GradStencil oStencil(*roVoxels->roVdbGrid());
         
@@ -256,7 +256,7 @@ public:
     {
         auto oField     = m_roGrid->getAccessor();
         auto oVoxels    = roVoxels->roVdbGrid()->getConstAccessor();
-        CoordBBox oBBox = roVoxels->roVdbGrid()->evalActiveVoxelBoundingBox();
+        CoordBBox oBBox = roVoxels->oActiveBBox();
         
         openvdb::Vec3s vec(vecValue.X, vecValue.Y, vecValue.Z);
         
@@ -38,13 +38,35 @@
 
 #include <openvdb/openvdb.h>
 #include <openvdb/tools/Composite.h>
+#include <openvdb/tools/Merge.h>
+#include <openvdb/tools/Prune.h>
+#include <openvdb/tools/SignedFloodFill.h>
+#include <openvdb/tree/NodeManager.h>
+#include <openvdb/tree/LeafManager.h>
 #include <openvdb/tools/MeshToVolume.h>
 #include <openvdb/tools/VolumeToMesh.h>
 #include <openvdb/tools/LevelSetRebuild.h>
 #include <openvdb/tools/LevelSetFilter.h>
+#include <openvdb/tools/LevelSetTracker.h>
+#include <openvdb/tools/LevelSetUtil.h>
+#include <openvdb/tools/FastSweeping.h>
 #include <openvdb/tools/RayIntersector.h>
+#include <openvdb/tools/Interpolation.h>
+#include <openvdb/tools/VolumeToSpheres.h>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/parallel_sort.h>
+#include <tbb/parallel_invoke.h>
+#include <tbb/parallel_reduce.h>
+
+#include <atomic>
+#include <initializer_list>
+#include <mutex>
 
 #include "PicoGKMesh.h"
+#include "PicoGKLattice.h"
 
 using namespace openvdb;
 
@@ -82,110 +104,310 @@ public:
     {
     }
     
-    bool bIsEqual(const Voxels& oCompare) const
+    bool bIsEqual(  const Voxels& oCompare,
+                    float fToleranceVx = 0.0f) const
     {
-        CoordBBox oBBoxThis = m_roGrid->evalActiveVoxelBoundingBox();
-        CoordBBox oBBoxComp = oCompare.m_roGrid->evalActiveVoxelBoundingBox();
-        
-        int32_t iMinX = std::min(   oBBoxThis.min().x(),
-                                    oBBoxComp.min().x());
-        
-        int32_t iMinY = std::min(   oBBoxThis.min().y(),
-                                    oBBoxComp.min().y());
-        
-        int32_t iMinZ = std::min(   oBBoxThis.min().z(),
-                                    oBBoxComp.min().z());
+        // With a tolerance of 0, two voxels are equal if both are inside
+        // or both are outside, otherwise their signed distances have to be
+        // within the tolerance (in voxels).
+        // Instead of scanning the volume, we walk the leaves of both trees
+        // in parallel, comparing whole leaves as bit masks where possible.
+        // Regions that are uniform in both trees (tiles, background) are
+        // compared with a single value. All threads stop at the first
+        // difference
+        
+        if (&oCompare == this)
+            return true;
         
-        int32_t iMaxX = std::max(   oBBoxThis.max().x(),
-                                    oBBoxComp.max().x());
+        FloatGrid::ConstPtr roA = m_roGrid;
+        FloatGrid::ConstPtr roB = oCompare.m_roGrid;
         
-        int32_t iMaxY = std::max(   oBBoxThis.max().y(),
-                                    oBBoxComp.max().y());
+        auto bValueEqual = [fToleranceVx](float fA, float fB)
+        {
+            if (fToleranceVx <= 0.0f)
+                return (fA <= 0.0f) == (fB <= 0.0f);
+            
+            return std::abs(fA - fB) <= fToleranceVx;
+        };
         
-        int32_t iMaxZ = std::max(   oBBoxThis.min().z(),
-                                    oBBoxComp.max().z());
+        if (!bValueEqual(roA->background(), roB->background()))
+            return false;
         
-        auto oThis = m_roGrid->getConstAccessor();
-        auto oComp = oCompare.m_roGrid->getConstAccessor();
+        std::atomic<bool> bDifferent(false);
         
-        for(int32_t x = iMinX; x <= iMaxX; x++)
-        for(int32_t y = iMinY; y <= iMaxY; y++)
-        for(int32_t z = iMinZ; z <= iMaxZ; z++)
+        // Leaves of one tree against the other tree, which has either a
+        // leaf at the same place, or a uniform value there.
+        // bSkipMatched avoids comparing leaf pairs twice
+        auto CompareLeaves = [&](   const FloatGrid& oThis,
+                                    const FloatGrid& oOther,
+                                    bool bSkipMatched)
         {
-            openvdb::Coord xyz(x,y,z);
+            tree::LeafManager<const FloatTree> oLeafs(oThis.tree());
+            
+            tbb::parallel_for(  tbb::blocked_range<size_t>(0, oLeafs.leafCount()),
+                                [&](const tbb::blocked_range<size_t>& oRange)
+            {
+                auto oAccess = oOther.getConstAccessor();
+                
+                for (size_t n=oRange.begin(); n<oRange.end(); n++)
+                {
+                    if (bDifferent.load(std::memory_order_relaxed))
+                        return;
+                    
+                    const FloatLeaf& oLeaf = oLeafs.leaf(n);
+                    const FloatLeaf* poOther = oAccess.probeConstLeaf(oLeaf.origin());
+                    
+                    if ((poOther != nullptr) && bSkipMatched)
+                        continue;
+                    
+                    bool bEqual = true;
+                    
+                    if (fToleranceVx <= 0.0f)
+                    {
+                        // compare word by word
+                        FloatLeaf::NodeMaskType oMask = oInsideMask(oLeaf);
+                        
+                        if (poOther != nullptr)
+                            bEqual = (oMask == oInsideMask(*poOther));
+                        else if (oAccess.getValue(oLeaf.origin()) <= 0.0f)
+                            bEqual = oMask.isOn();
+                        else
+                            bEqual = oMask.isOff();
+                    }
+                    else
+                    {
+                        float fUniform = oAccess.getValue(oLeaf.origin());
+                        
+                        for (Index nOffset=0; bEqual && (nOffset<FloatLeaf::SIZE); nOffset++)
+                        {
+                            float fOther = (poOther != nullptr) ? poOther->getValue(nOffset) : fUniform;
+                            bEqual = bValueEqual(oLeaf.getValue(nOffset), fOther);
+                        }
+                    }
+                    
+                    if (!bEqual)
+                    {
+                        bDifferent = true;
+                        return;
+                    }
+                }
+            });
+        };
+        
+        // Tiles of one tree, against the other tree, where the other tree
+        // is uniform over the whole tile. Where it is finer, its own tiles
+        // and leaves are compared in the other passes
+        auto bTilesEqual = [&]( const FloatGrid& oThis,
+                                const FloatGrid& oOther,
+                                bool bStrictlyCoarser)
+        {
+            auto oAccess = oOther.getConstAccessor();
             
-            bool bThisInside = (oThis.getValue(xyz) <= 0.0f);
-            bool bCompInside = (oComp.getValue(xyz) <= 0.0f);
+            FloatTree::ValueAllCIter iter = oThis.tree().cbeginValueAll();
+            iter.setMaxDepth(FloatTree::ValueAllCIter::LEAF_DEPTH - 1); // tiles only
             
-            if (bThisInside != bCompInside)
-                return false;
-        }
+            for (; iter; ++iter)
+            {
+                openvdb::Coord xyz = iter.getCoord();
+                int iDepth      = iter.getDepth();
+                int iOtherDepth = oAccess.getValueDepth(xyz); // -1 is background
+                
+                bool bUniform = bStrictlyCoarser ?  (iOtherDepth < iDepth) :
+                                                    (iOtherDepth <= iDepth);
+                if (!bUniform)
+                    continue;
+                
+                if (!bValueEqual(*iter, oAccess.getValue(xyz)))
+                    return false;
+            }
+            
+            return true;
+        };
         
-        return true;
-     }
+        if (!bTilesEqual(*roA, *roB, false))
+            return false;
+        
+        if (!bTilesEqual(*roB, *roA, true))
+            return false;
+        
+        CompareLeaves(*roA, *roB, false);
+        
+        if (!bDifferent)
+            CompareLeaves(*roB, *roA, true);
+        
+        return !bDifferent;
+    }
 
     void BoolAdd(const Voxels& oOther)
     {
-        FloatGrid::Ptr roOperand = deepCopyTypedGrid<FloatGrid>(oOther.m_roGrid);
-        openvdb::tools::csgUnion(*m_roGrid, *roOperand);
+        Changed();
+        
+        if (&oOther == this)
+            return;
+        
+        MergeCopyOnDemand<openvdb::tools::CsgUnionOp<FloatTree>>(oOther);
     }
 
     void BoolSubtract(const Voxels& oOther)
     {
-        FloatGrid::Ptr roOperand = deepCopyTypedGrid<FloatGrid>(oOther.m_roGrid);
-        openvdb::tools::csgDifference(*m_roGrid, *roOperand);
+        Changed();
+        
+        if (&oOther == this)
+        {
+            m_roGrid->clear();
+            return;
+        }
+        
+        MergeCopyOnDemand<openvdb::tools::CsgDifferenceOp<FloatTree>>(oOther);
     }
 
     void BoolIntersect(const Voxels& oOther)
     {
-        FloatGrid::Ptr roOperand = deepCopyTypedGrid<FloatGrid>(oOther.m_roGrid);
-        openvdb::tools::csgIntersection(*m_roGrid, *roOperand);
+        Changed();
+        
+        if (&oOther == this)
+            return;
+        
+        MergeCopyOnDemand<openvdb::tools::CsgIntersectionOp<FloatTree>>(oOther);
+    }
+    
+    void BoolAddMany(const std::vector<const Voxels*>& oOperands)
+    {
+        if (oOperands.empty())
+            return;
+        
+        if (oOperands.size() == 1)
+        {
+            // Nothing to union, only copy what ends up in the result
+            BoolAdd(*oOperands[0]);
+            return;
+        }
+        
+        Voxels::Ptr roUnion = roUnionOf(oOperands, 0, oOperands.size());
+        BoolAddConsume(*roUnion);
     }
     
-    void Offset(float fSize, VoxelSize oVoxelSize)
+    void BoolSubtractMany(const std::vector<const Voxels*>& oOperands)
     {
-        openvdb::tools::LevelSetFilter<openvdb::FloatGrid> oFilter(*m_roGrid);
+        if (oOperands.empty())
+            return;
+        
+        if (oOperands.size() == 1)
+        {
+            // Nothing to union, only copy what ends up in the result
+            BoolSubtract(*oOperands[0]);
+            return;
+        }
+        
+        Voxels::Ptr roUnion = roUnionOf(oOperands, 0, oOperands.size());
+        BoolSubtractConsume(*roUnion);
+    }
+    
+    // The consuming booleans steal the nodes of the operand
+    // and leave it empty, so nothing is copied at all
+    
+    void BoolAddConsume(Voxels& oOther)
+    {
+        Changed();
+        oOther.Changed();
+        
+        if (&oOther == this)
+            return;
+        
+        openvdb::tools::csgUnion(*m_roGrid, *oOther.m_roGrid);
+        oOther.m_roGrid->clear();
+    }
+    
+    void BoolSubtractConsume(Voxels& oOther)
+    {
+        Changed();
+        oOther.Changed();
+        
+        if (&oOther == this)
+        {
+            m_roGrid->clear();
+            return;
+        }
+        
+        openvdb::tools::csgDifference(*m_roGrid, *oOther.m_roGrid);
+        oOther.m_roGrid->clear();
+    }
+    
+    void BoolIntersectConsume(Voxels& oOther)
+    {
+        Changed();
+        oOther.Changed();
         
-        float fSizeVx = -oVoxelSize.fToVoxels(fSize); // openvdb treats offsets as inwards
+        if (&oOther == this)
+            return;
         
-        // The following command doesn't seem to be necessary, but verify
-        //oFilter.resize(std::abs(fSizeVx) + fBackground());
-        oFilter.offset(fSizeVx);
+        openvdb::tools::csgIntersection(*m_roGrid, *oOther.m_roGrid);
+        oOther.m_roGrid->clear();
+    }
+    
+    void Offset(float fSize, VoxelSize oVoxelSize)
+    {
+        Changed();
+        OffsetVx(oVoxelSize.fToVoxels(fSize));
     }
     
     void DoubleOffset(  float fSize1,
                         float fSize2,
                         VoxelSize oVoxelSize)
     {
-        openvdb::tools::LevelSetFilter<openvdb::FloatGrid> oFilter(*m_roGrid);
-        
-        float fSize1Vx = -oVoxelSize.fToVoxels(fSize1); // openvdb treats offsets as inwards
-        float fSize2Vx = -oVoxelSize.fToVoxels(fSize2); // openvdb treats offsets as inwards
-        
-        oFilter.offset(fSize1Vx);
-        oFilter.offset(fSize2Vx);
+        Changed();
+        OffsetSequenceVx({  oVoxelSize.fToVoxels(fSize1),
+                            oVoxelSize.fToVoxels(fSize2)});
     }
     
     void TripleOffset(  float fSize,
                         VoxelSize oVoxelSize)
     {
-        openvdb::tools::LevelSetFilter<openvdb::FloatGrid> oFilter(*m_roGrid);
-        
-        float fSizeVx = -oVoxelSize.fToVoxels(fSize); // openvdb treats offsets as inwards
-        
-        // offset inwards first
-        oFilter.offset(-fSizeVx);
+        Changed();
+        
+        // offset inwards first, then twice the size outwards,
+        // then inwards again. Now we are back where we started
+        // but have lost a lot of detail = smooth. Negative sizes
+        // run the opposite way (close, then open)
+        float fSizeVx = oVoxelSize.fToVoxels(fSize);
+        OffsetSequenceVx({-fSizeVx, fSizeVx * 2, -fSizeVx});
+    }
+    
+    enum ESmoothMode
+    {
+        eSmoothOpen         = 0,    // removes features thinner than 2x the size
+        eSmoothClose        = 1,    // fills gaps and concave corners
+        eSmoothOpenClose    = 2     // both, TripleOffset with a positive size
+    };
+    
+    void Smoothen(  float fSize,
+                    ESmoothMode eMode,
+                    VoxelSize oVoxelSize)
+    {
+        Changed();
         
-        // offset twice the size outwards next
-        oFilter.offset(fSizeVx * 2);
+        float fSizeVx = oVoxelSize.fToVoxels(std::abs(fSize));
         
-        // offset inwards again. Now we are back where we started
-        // but have lost a lot of detail = smooth
-        oFilter.offset(-fSizeVx);
+        switch (eMode)
+        {
+            case eSmoothOpen:
+                OffsetSequenceVx({-fSizeVx, fSizeVx});
+                break;
+                
+            case eSmoothClose:
+                OffsetSequenceVx({fSizeVx, -fSizeVx});
+                break;
+                
+            case eSmoothOpenClose:
+                OffsetSequenceVx({-fSizeVx, fSizeVx * 2, -fSizeVx});
+                break;
+        }
     }
     
     void Gaussian(float fSize, VoxelSize oVoxelSize)
     {
+        Changed();
+        
         openvdb::tools::LevelSetFilter<openvdb::FloatGrid> oFilter(*m_roGrid);
         float fSizeVx = oVoxelSize.fToVoxels(std::abs(fSize));
         oFilter.gaussian(fSizeVx);
@@ -193,6 +415,8 @@ public:
     
     void Median(float fSize, VoxelSize oVoxelSize)
     {
+        Changed();
+        
         openvdb::tools::LevelSetFilter<openvdb::FloatGrid> oFilter(*m_roGrid);
         float fSizeVx = oVoxelSize.fToVoxels(std::abs(fSize));
         oFilter.median(fSizeVx);
@@ -200,38 +424,109 @@ public:
     
     void Mean(float fSize, VoxelSize oVoxelSize)
     {
+        Changed();
+        
         openvdb::tools::LevelSetFilter<openvdb::FloatGrid> oFilter(*m_roGrid);
         float fSizeVx = oVoxelSize.fToVoxels(std::abs(fSize));
         oFilter.mean(fSizeVx);
     }
 
+    void Renormalize()
+    {
+        // Restores the signed distance property of the narrow band, after
+        // rendering min-combined values which were only distance bounds.
+        // Each normalization step moves information by about half a voxel,
+        // so twice the band width in steps covers the whole band
+        
+        Changed();
+        
+        if (m_roGrid->tree().leafCount() == 0)
+            return;
+        
+        openvdb::tools::LevelSetTracker<openvdb::FloatGrid> oTracker(*m_roGrid);
+        oTracker.setNormCount((int) std::ceil(2.0f * fBackground()));
+        oTracker.track();
+    }
+    
+    int64_t nCompact(bool bSignedFloodFill)
+    {
+        // Replaces inactive leaves that only hold +/- background values
+        // by tiles and returns the number of bytes reclaimed
+        
+        int64_t nBefore = (int64_t) roStatistics()->nMemoryBytes;
+        
+        Changed();
+        
+        if (bSignedFloodFill)
+            openvdb::tools::signedFloodFill(m_roGrid->tree());
+        
+        openvdb::tools::pruneLevelSet(m_roGrid->tree());
+        
+        return nBefore - (int64_t) m_roGrid->tree().memUsage();
+    }
+    
+    enum EFilter
+    {
+        eFilterOffset       = 0,
+        eFilterGaussian     = 1,
+        eFilterMedian       = 2,
+        eFilterMean         = 3
+    };
+    
+    void FilterInBBox(  EFilter eFilter,
+                        float fSize,
+                        const BBox3& oBBox,
+                        VoxelSize oVoxelSize)
+    {
+        Coord xyzMin = oVoxelSize.xyzToVoxels(oBBox.vecMin);
+        Coord xyzMax = oVoxelSize.xyzToVoxels(oBBox.vecMax);
+        
+        CoordBBox oRegion(  openvdb::Coord(xyzMin.X, xyzMin.Y, xyzMin.Z),
+                            openvdb::Coord(xyzMax.X, xyzMax.Y, xyzMax.Z));
+        
+        FloatGrid::Ptr roAlpha = FloatGrid::create(0.0f);
+        roAlpha->setTransform(m_roGrid->transform().copy());
+        roAlpha->fill(oRegion, 1.0f, true);
+        
+        Changed();
+        FilterRegion(eFilter, oVoxelSize.fToVoxels(fSize), oRegion, *roAlpha);
+    }
+    
+    void FilterMasked(  EFilter eFilter,
+                        float fSize,
+                        const Voxels& oMask,
+                        VoxelSize oVoxelSize)
+    {
+        // The inside of the mask is fully filtered, with a smooth
+        // transition across its narrow band
+        
+        FloatGrid::Ptr roAlpha = oMask.m_roGrid->deepCopy();
+        openvdb::tools::sdfToFogVolume(*roAlpha);
+        
+        FilterAlphaMasked(eFilter, fSize, *roAlpha, oVoxelSize);
+    }
+    
+    void FilterAlphaMasked( EFilter eFilter,
+                            float fSize,
+                            const FloatGrid& oAlpha,
+                            VoxelSize oVoxelSize)
+    {
+        // oAlpha blends between the original (0) and the
+        // filtered result (1), like a scalar field
+        
+        CoordBBox oRegion = oAlpha.evalActiveVoxelBoundingBox();
+        
+        Changed();
+        FilterRegion(eFilter, oVoxelSize.fToVoxels(fSize), oRegion, oAlpha);
+    }
+    
     void RenderMesh(	const Mesh& oMesh,
     					VoxelSize oVoxelSize)
     {
-        // We have to convert the mesh to voxel coords before
-        // we transfer it to openvdb for rendering
-        // We should use the openvdb transformations in the
-        // future and inform the openvdb float grid of our
-        // voxel size. This is, however, a bit of a larger
-        // project and will be done at a later time.
-        
-        Mesh oMeshInVoxelCoord;
-        for (int32_t n=0; n<oMesh.nTriangleCount(); n++)
-        {
-            Vector3 vecA(0,0,0);
-            Vector3 vecB(0,0,0);
-            Vector3 vecC(0,0,0);
-            oMesh.GetTriangle(n, &vecA, &vecB, &vecC);
-            
-            vecA = oVoxelSize.vecToVoxels(vecA);
-            vecB = oVoxelSize.vecToVoxels(vecB);
-            vecC = oVoxelSize.vecToVoxels(vecC);
-            
-            oMeshInVoxelCoord.nAddTriangle(vecA, vecB, vecC);
-        }
+        Changed();
         
-        FloatGrid::Ptr roVoxelized = roFloatGridFromMesh(   oMeshInVoxelCoord,
-                                                            1.0f,
+        FloatGrid::Ptr roVoxelized = roFloatGridFromMesh(   oMesh,
+                                                            oVoxelSize,
                                                             fBackground());
         
         openvdb::tools::csgUnion(*m_roGrid, *roVoxelized);
@@ -240,23 +535,145 @@ public:
     void RenderLattice( const Lattice& oLattice,
                         float fVoxelSizeMM)
     {
-        auto oAccess = m_roGrid->getAccessor();
+        Changed();
+        
+        // We bucket all primitives by the leaf nodes their padded bounding
+        // box touches. Then every leaf is computed exactly once, in parallel,
+        // taking the minimum of only the primitives that overlap it
+        
+        VoxelSize oVoxelSize(fVoxelSizeMM);
+        
+        const LatticeSpheres&       oSpheres    = oLattice.oSpheres();
+        const LatticeRoundCones&    oRoundCones = oLattice.oRoundCones();
+        const LatticeFlatCones&     oFlatCones  = oLattice.oFlatCones();
+        
+        // primitive indices are spheres, then round cones, then flat cones
+        size_t nSpheres     = oSpheres.nCount();
+        size_t nRoundEnd    = nSpheres + oRoundCones.nCount();
+        size_t nPrimitives  = nRoundEnd + oFlatCones.nCount();
+        
+        if (nPrimitives == 0)
+            return;
+        
+        std::vector<CoordBBox>  oPrimBBoxes(nPrimitives);
+        std::vector<size_t>     oBucketStart(nPrimitives + 1, 0);
         
-        for (auto roSphere : oLattice.oSpheres())
+        tbb::parallel_for(  tbb::blocked_range<size_t>(0, nPrimitives),
+                            [&](const tbb::blocked_range<size_t>& oRange)
         {
-            DoRenderLattice(&oAccess, fBackground(), *roSphere, fVoxelSizeMM);
-        }
+            for (size_t n=oRange.begin(); n<oRange.end(); n++)
+            {
+                BBox3 oBBox =   (n < nSpheres)  ? oSpheres.oBBox(n) :
+                                (n < nRoundEnd) ? oRoundCones.oBBox(n - nSpheres) :
+                                                  oFlatCones.oBBox(n - nRoundEnd);
+                
+                oPrimBBoxes[n]      = oPaddedVoxelBBox(oBBox, oVoxelSize);
+                oBucketStart[n+1]   = nLeafCount(oPrimBBoxes[n]);
+            }
+        });
+        
+        for (size_t n=0; n<nPrimitives; n++)
+            oBucketStart[n+1] += oBucketStart[n];
+        
+        // (leaf origin, primitive index), one entry per touched leaf
+        std::vector<std::pair<openvdb::Coord, uint32_t>> oEntries(oBucketStart[nPrimitives]);
+        
+        tbb::parallel_for(  tbb::blocked_range<size_t>(0, nPrimitives),
+                            [&](const tbb::blocked_range<size_t>& oRange)
+        {
+            for (size_t n=oRange.begin(); n<oRange.end(); n++)
+            {
+                size_t nEntry = oBucketStart[n];
+                for (const openvdb::Coord& xyzLeaf : oLeafOrigins(oPrimBBoxes[n]))
+                {
+                    oEntries[nEntry] = {xyzLeaf, (uint32_t) n};
+                    nEntry++;
+                }
+            }
+        });
         
-        for (auto roBeam : oLattice.oBeams())
+        tbb::parallel_sort(oEntries.begin(), oEntries.end());
+        
+        std::vector<openvdb::Coord> oLeafs;
+        std::vector<size_t>         oLeafStart;
+        
+        for (size_t n=0; n<oEntries.size(); n++)
         {
-            DoRenderLattice(&oAccess, fBackground(), *roBeam, fVoxelSizeMM);
+            if ((n == 0) || (oEntries[n].first != oEntries[n-1].first))
+            {
+                oLeafs.push_back(oEntries[n].first);
+                oLeafStart.push_back(n);
+            }
         }
+        
+        oLeafStart.push_back(oEntries.size());
+        
+        // Primitives are evaluated a leaf row at a time (8 voxels along Z)
+        // by the SIMD kernels, which are picked once for the current CPU
+        static_assert(FloatLeaf::DIM == LatticeSimd::nRowSize, "Leaf row has to match kernel width");
+        
+        const LatticeSimd::Kernels& oKernels = LatticeSimd::oKernels();
+        
+        RenderLeafValuesParallel(   oLeafs,
+                                    [&](size_t nLeaf, const openvdb::Coord& xyzOrigin, float* pfValues)
+        {
+            std::fill(pfValues, pfValues + FloatLeaf::SIZE, std::numeric_limits<float>::max());
+            
+            CoordBBox oLeafBBox(xyzOrigin, xyzOrigin.offsetBy(FloatLeaf::DIM - 1));
+            float fZ = oVoxelSize.fToMM(xyzOrigin.z());
+            float afRow[LatticeSimd::nRowSize];
+            
+            // the constants are gathered once per primitive and leaf
+            auto RenderRows = [&](  const CoordBBox& oBox,
+                                    const auto& oConsts,
+                                    auto pfnRow)
+            {
+                for (int32_t x=oBox.min().x(); x<=oBox.max().x(); x++)
+                for (int32_t y=oBox.min().y(); y<=oBox.max().y(); y++)
+                {
+                    pfnRow( oConsts,
+                            oVoxelSize.fToMM(x),
+                            oVoxelSize.fToMM(y),
+                            fZ,
+                            fVoxelSizeMM,
+                            afRow);
+                    
+                    Index nRow = FloatLeaf::coordToOffset(openvdb::Coord(x, y, xyzOrigin.z()));
+                    
+                    for (int32_t z=oBox.min().z(); z<=oBox.max().z(); z++)
+                    {
+                        int32_t iZ = z - xyzOrigin.z();
+                        pfValues[nRow + iZ] = std::min( pfValues[nRow + iZ],
+                                                        oVoxelSize.fToVoxels(afRow[iZ]));
+                    }
+                }
+            };
+            
+            for (size_t n=oLeafStart[nLeaf]; n<oLeafStart[nLeaf+1]; n++)
+            {
+                size_t nPrim = oEntries[n].second;
+                
+                // only inside the padded bounding box, like
+                // rendering each primitive by itself
+                CoordBBox oBox = oPrimBBoxes[nPrim];
+                oBox.intersect(oLeafBBox);
+                
+                if (nPrim < nSpheres)
+                    RenderRows(oBox, oSpheres.oConsts(nPrim), oKernels.pfnSphereRow);
+                else if (nPrim < nRoundEnd)
+                    RenderRows(oBox, oRoundCones.oConsts(nPrim - nSpheres), oKernels.pfnRoundConeRow);
+                else
+                    RenderRows(oBox, oFlatCones.oConsts(nPrim - nRoundEnd), oKernels.pfnFlatConeRow);
+            }
+        });
     }
     
     void RenderImplicit(    const BBox3& oBBox,
                             PKPFnfSdf pfn,
                             VoxelSize oVoxelSize)
     {
+        Changed();
+        
         auto oAccess = m_roGrid->getAccessor();
         
         Coord xyzMin = oVoxelSize.xyzToVoxels(oBBox.vecMin);
@@ -280,12 +697,202 @@ public:
         }
     }
     
+    void RenderImplicitParallel(    const BBox3& oBBox,
+                                    PKPFnfSdf pfn,
+                                    VoxelSize oVoxelSize)
+    {
+        Changed();
+        
+        // Same result as RenderImplicit, but the bounding box is split into
+        // leaf-aligned tiles which are evaluated concurrently, so the
+        // callback function has to be thread-safe
+        
+        CoordBBox oBBoxVx = oPaddedVoxelBBox(oBBox, oVoxelSize);
+        
+        RenderLeavesParallel(   oLeafOrigins(oBBoxVx),
+                                oBBoxVx,
+                                [&](size_t, const openvdb::Coord& xyz)
+                                {
+                                    Vector3 vecSample = oVoxelSize.vecToMM(Coord(   xyz.x(),
+                                                                                    xyz.y(),
+                                                                                    xyz.z()));
+                                    
+                                    return oVoxelSize.fToVoxels((*pfn)(&vecSample));
+                                });
+    }
+    
+    void RenderImplicitNarrowBand(  const BBox3& oBBox,
+                                    PKPFnfSdf pfn,
+                                    float fLipschitz,
+                                    VoxelSize oVoxelSize)
+    {
+        RenderNarrowBand(   oBBox,
+                            fLipschitz,
+                            oVoxelSize,
+                            [pfn](const Vector3& vecSample)
+                            {
+                                return (*pfn)(&vecSample);
+                            });
+    }
+    
+    void RenderMeshImplicit(    const Mesh& oMesh,
+                                VoxelSize oVoxelSize)
+    {
+        // Renders the exact signed distance to the mesh, without
+        // voxelizing it first. The mesh has to be closed for the sign
+        
+        if (oMesh.nTriangleCount() == 0)
+            return;
+        
+        BBox3 oBBox;
+        oMesh.GetBoundingBox(&oBBox);
+        
+        MeshBvh::Ptr roBvh = oMesh.roBvh();
+        
+        RenderNarrowBand(   oBBox,
+                            1.0f,
+                            oVoxelSize,
+                            [&roBvh](const Vector3& vecSample)
+                            {
+                                return roBvh->fSignedDistance(vecSample);
+                            });
+    }
+    
+    template <class TFnSdf>
+    void RenderNarrowBand(  const BBox3& oBBox,
+                            float fLipschitz,
+                            VoxelSize oVoxelSize,
+                            const TFnSdf& fnSdf)
+    {
+        Changed();
+        
+        // Hierarchical, parallel version of RenderImplicit
+        // fnSdf(vecMM) returns the signed distance in mm and has to be thread-safe.
+        // fLipschitz bounds how fast the function changes (1 for a true SDF).
+        // We sample blocks at their center. If the value is far enough from
+        // the surface, the whole block is provably outside (nothing to do)
+        // or inside (filled with an interior tile). Otherwise we subdivide
+        // down to leaf level, so only the narrow band is evaluated per voxel
+        
+        if (fLipschitz <= 0.0f)
+            fLipschitz = 1.0f;
+        
+        CoordBBox oBBoxVx = oPaddedVoxelBBox(oBBox, oVoxelSize);
+        
+        if (oBBoxVx.empty())
+            return;
+        
+        float fBack         = fBackground();
+        float fVoxelSizeMM  = oVoxelSize;
+        
+        struct Blocks
+        {
+            std::vector<openvdb::Coord> oLeafs;
+            std::vector<CoordBBox>      oInside;
+        };
+        
+        tbb::enumerable_thread_specific<Blocks> oThreadBlocks;
+        
+        std::vector<openvdb::Coord> oTopBlocks = oAlignedOrigins(   oBBoxVx,
+                                                                    (int32_t) FloatLowerNode::DIM);
+        
+        tbb::parallel_for(  tbb::blocked_range<size_t>(0, oTopBlocks.size()),
+                            [&](const tbb::blocked_range<size_t>& oRange)
+        {
+            Blocks& oBlocks = oThreadBlocks.local();
+            std::vector<std::pair<openvdb::Coord, int32_t>> oStack;
+            
+            for (size_t n=oRange.begin(); n<oRange.end(); n++)
+            {
+                oStack.push_back({oTopBlocks[n], (int32_t) FloatLowerNode::DIM});
+                
+                while (!oStack.empty())
+                {
+                    openvdb::Coord  xyz     = oStack.back().first;
+                    int32_t         iSize   = oStack.back().second;
+                    oStack.pop_back();
+                    
+                    CoordBBox oBlock(xyz, xyz.offsetBy(iSize - 1));
+                    
+                    if (!oBlock.hasOverlap(oBBoxVx))
+                        continue;
+                    
+                    float fHalf = 0.5f * (float) (iSize - 1);
+                    
+                    Vector3 vecCenter(  (xyz.x() + fHalf) * fVoxelSizeMM,
+                                        (xyz.y() + fHalf) * fVoxelSizeMM,
+                                        (xyz.z() + fHalf) * fVoxelSizeMM);
+                    
+                    float fDist     = fnSdf(vecCenter) / fVoxelSizeMM;
+                    float fRadius   = fLipschitz * fHalf * std::sqrt(3.0f);
+                    
+                    if (fDist - fRadius >= fBack)
+                        continue; // fully outside, leaves existing values untouched
+                    
+                    if (fDist + fRadius <= -fBack)
+                    {
+                        // fully inside
+                        oBlock.intersect(oBBoxVx);
+                        oBlocks.oInside.push_back(oBlock);
+                        continue;
+                    }
+                    
+                    if (iSize <= (int32_t) FloatLeaf::DIM)
+                    {
+                        oBlocks.oLeafs.push_back(xyz);
+                        continue;
+                    }
+                    
+                    int32_t iHalf = iSize / 2;
+                    
+                    for (int32_t i=0; i<8; i++)
+                    {
+                        oStack.push_back({  xyz.offsetBy(   (i & 1) ? iHalf : 0,
+                                                            (i & 2) ? iHalf : 0,
+                                                            (i & 4) ? iHalf : 0),
+                                            iHalf});
+                    }
+                }
+            }
+        });
+        
+        std::vector<openvdb::Coord> oLeafs;
+        
+        for (Blocks& oBlocks : oThreadBlocks)
+        {
+            oLeafs.insert(  oLeafs.end(),
+                            oBlocks.oLeafs.begin(),
+                            oBlocks.oLeafs.end());
+        }
+        
+        RenderLeavesParallel(   oLeafs,
+                                oBBoxVx,
+                                [&](size_t, const openvdb::Coord& xyz)
+                                {
+                                    Vector3 vecSample(  xyz.x() * fVoxelSizeMM,
+                                                        xyz.y() * fVoxelSizeMM,
+                                                        xyz.z() * fVoxelSizeMM);
+                                    
+                                    return fnSdf(vecSample) / fVoxelSizeMM;
+                                });
+        
+        // Interior blocks don't overlap any of the leaves above,
+        // so filling them with inactive interior tiles is independent
+        for (Blocks& oBlocks : oThreadBlocks)
+        {
+            for (const CoordBBox& oInside : oBlocks.oInside)
+                m_roGrid->tree().fill(oInside, -fBack, false);
+        }
+    }
+    
     void IntersectImplicit( PKPFnfSdf pfn,
                             VoxelSize oVoxelSize)
     {
-        Voxels oVox(fBackground());
+        CoordBBox oBBox = oActiveBBox();
         
-        CoordBBox oBBox = m_roGrid->evalActiveVoxelBoundingBox();
+        Changed();
+        
+        Voxels oVox(fBackground());
         
         BBox3 oBBoxMM;
         oBBoxMM.vecMin.X = oVoxelSize.fToMM(oBBox.min().x());
@@ -307,45 +914,93 @@ public:
         BoolIntersect(oVox);
     }
 
-    Mesh::Ptr roAsMesh(float fVoxelSizeMM) const
+    Mesh::Ptr roAsMesh( float fVoxelSizeMM,
+                        float fAdaptivity = 0.0f) const
     {
-        Mesh::Ptr roMesh = std::make_shared<Mesh>();
+        // Runs the mesher directly and writes its output straight into
+        // presized mesh buffers, instead of collecting it in temporary
+        // vectors first and adding the elements one by one
+        //
+        // fAdaptivity (0..1) merges polygons in flat regions, at 0 the
+        // whole surface has the same density
         
-    	std::vector< openvdb::Vec3s > oPoints;
-    	std::vector< openvdb::Vec3I > oTriangles;
-    	std::vector< openvdb::Vec4I > oQuads;
-		
-        openvdb::tools::volumeToMesh<openvdb::FloatGrid>(*m_roGrid,
-                                                         oPoints,
-                                                         oTriangles,
-                                                         oQuads,
-                                                         0.0f,
-                                                         0.0,
-                                                         false);
-
-        for (const openvdb::Vec4I oQuad : oQuads)
+        fAdaptivity = std::clamp(fAdaptivity, 0.0f, 1.0f);
+        
+        openvdb::tools::VolumeToMesh oMesher(   0.0,
+                                                fAdaptivity,
+                                                fAdaptivity > 0.0f);
+        oMesher(*m_roGrid);
+        
+        size_t nPoints = oMesher.pointListSize();
+        const openvdb::Vec3s* pvecPoints = oMesher.pointList().get();
+        
+        std::vector<Vector3> oVertices(nPoints);
+        
+        BBox3 oBBox = tbb::parallel_reduce(
+                            tbb::blocked_range<size_t>(0, nPoints),
+                            BBox3(),
+                            [&](const tbb::blocked_range<size_t>& oRange, BBox3 oPartial)
         {
-            openvdb::Vec3I o1(oQuad[0], oQuad[1], oQuad[2]);
-            oTriangles.push_back(o1);
-
-            openvdb::Vec3I o2(oQuad[2], oQuad[3], oQuad[0]);
-            oTriangles.push_back(o2);
-        }
-	    
-        for (const openvdb::Vec3s& v : oPoints)
+            for (size_t n=oRange.begin(); n<oRange.end(); n++)
+            {
+                const openvdb::Vec3s& v = pvecPoints[n];
+                oVertices[n] = Vector3(v.x(), v.y(), v.z()) * fVoxelSizeMM;
+                oPartial.Include(oVertices[n]);
+            }
+            
+            return oPartial;
+        },
+                            [](BBox3 oA, const BBox3& oB)
         {
-            Vector3 vec(v.x(), v.y(), v.z());
-            vec *= fVoxelSizeMM;
-            roMesh->nAddVertex(vec);
-        }
-
-        for (const openvdb::Vec3I oTri : oTriangles)
+            oA.Include(oB);
+            return oA;
+        });
+        
+        oMesher.pointList().reset(nullptr);
+        
+        // Each quad is split into two triangles, the first triangle
+        // of each polygon pool is found by a prefix sum
+        
+        openvdb::tools::PolygonPoolList& oPools = oMesher.polygonPoolList();
+        size_t nPools = oMesher.polygonPoolListSize();
+        
+        std::vector<size_t> oFirstTriangle(nPools + 1, 0);
+        for (size_t n=0; n<nPools; n++)
         {
-            roMesh->nAddTriangle(   PicoGK::Triangle(   oTri[2],
-                                                        oTri[1],
-                                                        oTri[0]));
+            oFirstTriangle[n+1] =   oFirstTriangle[n]
+                                    + oPools[n].numQuads() * 2
+                                    + oPools[n].numTriangles();
         }
-
+        
+        std::vector<Triangle> oTriangles(oFirstTriangle[nPools]);
+        
+        tbb::parallel_for(  tbb::blocked_range<size_t>(0, nPools),
+                            [&](const tbb::blocked_range<size_t>& oRange)
+        {
+            for (size_t nPool=oRange.begin(); nPool<oRange.end(); nPool++)
+            {
+                const openvdb::tools::PolygonPool& oPool = oPools[nPool];
+                Triangle* psTri = &oTriangles[oFirstTriangle[nPool]];
+                
+                // openvdb winds its polygons the other way round
+                
+                for (size_t n=0; n<oPool.numQuads(); n++)
+                {
+                    const openvdb::Vec4I& oQuad = oPool.quad(n);
+                    *psTri++ = Triangle(oQuad[2], oQuad[1], oQuad[0]);
+                    *psTri++ = Triangle(oQuad[0], oQuad[3], oQuad[2]);
+                }
+                
+                for (size_t n=0; n<oPool.numTriangles(); n++)
+                {
+                    const openvdb::Vec3I& oTri = oPool.triangle(n);
+                    *psTri++ = Triangle(oTri[2], oTri[1], oTri[0]);
+                }
+            }
+        });
+        
+        Mesh::Ptr roMesh = std::make_shared<Mesh>();
+        roMesh->SetBuffers(std::move(oVertices), std::move(oTriangles), oBBox);
         return roMesh;
     }
     
@@ -355,39 +1010,14 @@ public:
     {
         assert(fZStart > fZEnd);
         
-        int32_t iZStart = oVoxelSize.iToVoxels(fZStart);
-        int32_t iZEnd   = oVoxelSize.iToVoxels(fZEnd);
-        CoordBBox oBBox = m_roGrid->evalActiveVoxelBoundingBox();
+        CoordBBox oBBox = oActiveBBox();
         
-        auto oAccess = m_roGrid->getAccessor();
+        Changed();
         
-        for(int32_t x = oBBox.min().x(); x <= oBBox.max().x(); x++)
-        for(int32_t y = oBBox.min().y(); y <= oBBox.max().y(); y++)
-        for(int32_t z = iZStart; z > iZEnd; z--)
-        {
-            
-            openvdb::Coord xyz(x,y,z);
-            openvdb::Coord xyzUnder(x,y,z-1);
-            
-            float fValue = std::min(    oAccess.getValue(xyzUnder),
-                                        oAccess.getValue(xyz));
-            
-            SetSdValue(&oAccess, xyzUnder, m_roGrid->background(), fValue);
-        }
-        
-        // Close the last slice, and update the background
-        for(int32_t z = iZEnd; z > iZEnd - (int) (0.5f + m_roGrid->background()); z--)
-        {
-            for(int32_t x = oBBox.min().x(); x <= oBBox.max().x(); x++)
-            for(int32_t y = oBBox.min().y(); y <= oBBox.max().y(); y++)
-            {
-                openvdb::Coord xyz(x,y,z);
-                openvdb::Coord xyzUnder(x,y,z-1);
-                
-                float fValue = (oAccess.getValue(xyz) + oAccess.getValue(xyzUnder)) / 2.0f;
-                SetSdValue(&oAccess, xyz, m_roGrid->background(), fValue);
-            }
-        }
+        ProjectZColumns(    oBBox,
+                            oVoxelSize.iToVoxels(fZStart),
+                            oVoxelSize.iToVoxels(fZEnd),
+                            -1);
     }
     
     void ProjectZSliceUp(   float fZStart,
@@ -396,38 +1026,14 @@ public:
     {
         assert(fZStart < fZEnd);
         
-        int32_t iZStart = oVoxelSize.iToVoxels(fZStart);
-        int32_t iZEnd   = oVoxelSize.iToVoxels(fZEnd);
-        CoordBBox oBBox = m_roGrid->evalActiveVoxelBoundingBox();
-        
-        auto oAccess = m_roGrid->getAccessor();
+        CoordBBox oBBox = oActiveBBox();
         
-        for(int32_t x = oBBox.min().x(); x <= oBBox.max().x(); x++)
-        for(int32_t y = oBBox.min().y(); y <= oBBox.max().y(); y++)
-        for(int32_t z = iZStart; z < iZEnd; z++)
-        {
-            openvdb::Coord xyz(x,y,z);
-            openvdb::Coord xyzOver(x,y,z+1);
-            
-            float fValue = std::min(    oAccess.getValue(xyzOver),
-                                        oAccess.getValue(xyz));
-            
-            SetSdValue(&oAccess, xyzOver, m_roGrid->background(), fValue);
-        }
+        Changed();
         
-        // Close the last slice, and update the background
-        for(int32_t z = iZEnd; z < iZEnd + (int) (0.5f + m_roGrid->background()); z++)
-        {
-            for(int32_t x = oBBox.min().x(); x <= oBBox.max().x(); x++)
-            for(int32_t y = oBBox.min().y(); y <= oBBox.max().y(); y++)
-            {
-                openvdb::Coord xyz(x,y,z);
-                openvdb::Coord xyzOver(x,y,z+1);
-                
-                float fValue = (oAccess.getValue(xyz) + oAccess.getValue(xyzOver)) / 2.0f;
-                SetSdValue(&oAccess, xyz, m_roGrid->background(), fValue);
-            }
-        }
+        ProjectZColumns(    oBBox,
+                            oVoxelSize.iToVoxels(fZStart),
+                            oVoxelSize.iToVoxels(fZEnd),
+                            1);
     }
 
     void ProjectZSlice( float fZStart,
@@ -444,33 +1050,79 @@ public:
                                 BBox3* poBBox,
                                 VoxelSize oVoxelSize)
     {
-        CoordBBox oBBox = m_roGrid->evalActiveVoxelBoundingBox();
-        
-        auto oAccess = m_roGrid->getConstAccessor();
+        float   fArea;
+        Vector3 vecCentroid(0,0,0);
+        Vector3 vecInertiaDiag(0,0,0);
+        Vector3 vecInertiaOffDiag(0,0,0);
+        
+        CalculateMassProperties(    pfVolume,
+                                    &fArea,
+                                    &vecCentroid,
+                                    &vecInertiaDiag,
+                                    &vecInertiaOffDiag,
+                                    poBBox,
+                                    oVoxelSize);
+    }
+    
+    void CalculateMassProperties(   float*      pfVolume,
+                                    float*      pfSurfaceArea,
+                                    Vector3*    pvecCentroid,
+                                    Vector3*    pvecInertiaDiag,
+                                    Vector3*    pvecInertiaOffDiag,
+                                    BBox3*      poBBox,
+                                    VoxelSize   oVoxelSize) const
+    {
+        // Inertia is about the centroid, for a density of 1,
+        // the off-diagonal terms are returned as (xy, xz, yz)
         
-        int nCount = 0;
+        Moments oMom = oCalculateMoments();
         
-        BBox3 oResult;
+        double fVoxel   = (float) oVoxelSize;
+        double fVolume  = oMom.fVolume;
+        double afC[3]   = {0.0, 0.0, 0.0};
         
-        for (int32_t x=oBBox.min().x(); x<=oBBox.max().x(); x++)
-        for (int32_t y=oBBox.min().y(); y<=oBBox.max().y(); y++)
-        for (int32_t z=oBBox.min().z(); z<=oBBox.max().z(); z++)
+        if (fVolume > 0.0)
         {
-            if (oAccess.getValue(openvdb::Coord(x,y,z)) <= 0.0f)
-            {
-                // Voxel is set
-                nCount++;
-                oResult.Include(oVoxelSize.vecToMM(Coord(x,y,z)));
-            }
+            for (int n=0; n<3; n++)
+                afC[n] = oMom.afFirst[n] / fVolume;
         }
         
-        float fVolume = nCount;
-        fVolume *= oVoxelSize;
-        fVolume *= oVoxelSize;
-        fVolume *= oVoxelSize; // cubic!
+        // second moments about the centroid
+        double fXX = oMom.afSecond[0] - fVolume * afC[0] * afC[0];
+        double fYY = oMom.afSecond[1] - fVolume * afC[1] * afC[1];
+        double fZZ = oMom.afSecond[2] - fVolume * afC[2] * afC[2];
+        double fXY = oMom.afSecond[3] - fVolume * afC[0] * afC[1];
+        double fXZ = oMom.afSecond[4] - fVolume * afC[0] * afC[2];
+        double fYZ = oMom.afSecond[5] - fVolume * afC[1] * afC[2];
         
-        *pfVolume   = fVolume;
-        *poBBox     = oResult;
+        double fVoxel5 = fVoxel * fVoxel * fVoxel * fVoxel * fVoxel;
+        
+        *pfVolume       = (float) (fVolume * fVoxel * fVoxel * fVoxel);
+        *pfSurfaceArea  = (float) (oMom.fArea * fVoxel * fVoxel);
+        
+        *pvecCentroid   = Vector3(  (float) (afC[0] * fVoxel),
+                                    (float) (afC[1] * fVoxel),
+                                    (float) (afC[2] * fVoxel));
+        
+        *pvecInertiaDiag    = Vector3(  (float) ((fYY + fZZ) * fVoxel5),
+                                        (float) ((fXX + fZZ) * fVoxel5),
+                                        (float) ((fXX + fYY) * fVoxel5));
+        
+        *pvecInertiaOffDiag = Vector3(  (float) (-fXY * fVoxel5),
+                                        (float) (-fXZ * fVoxel5),
+                                        (float) (-fYZ * fVoxel5));
+        
+        BBox3 oResult;
+        if (!oMom.oInside.empty())
+        {
+            const openvdb::Coord& xyzMin = oMom.oInside.min();
+            const openvdb::Coord& xyzMax = oMom.oInside.max();
+            
+            oResult.Include(oVoxelSize.vecToMM(Coord(xyzMin.x(), xyzMin.y(), xyzMin.z())));
+            oResult.Include(oVoxelSize.vecToMM(Coord(xyzMax.x(), xyzMax.y(), xyzMax.z())));
+        }
+        
+        *poBBox = oResult;
     }
     
     inline void GetSurfaceNormal(   Vector3 vecPt,
@@ -492,81 +1144,239 @@ public:
         pvecNormal->Z = vecGradient.z();
     }
     
-    inline bool bFindClosestPointOnSurface( Vector3 vecSearch,
-                                            VoxelSize oVoxelSize,
-                                            Vector3* pvecSurfacePoint)
+    bool bIsInside( const Vector3& vecTestPoint,
+                    VoxelSize oVoxelSize) const
     {
-        Coord xyzSearch = oVoxelSize.xyzToVoxels(vecSearch);
+        auto oAccess = m_roGrid->getConstAccessor();
         
-        CoordBBox oBBox = m_roGrid->evalActiveVoxelBoundingBox();
-        oBBox.expand(openvdb::Coord(xyzSearch.X, xyzSearch.Y, xyzSearch.Z));
-        // Add the search point to the BBox and expand a little to avoid
-        // stopping too soon
+        Vec3R xyz(  oVoxelSize.fToVoxels(vecTestPoint.X),
+                    oVoxelSize.fToVoxels(vecTestPoint.Y),
+                    oVoxelSize.fToVoxels(vecTestPoint.Z));
         
-        auto oAccess    = m_roGrid->getConstAccessor();
+        return tools::BoxSampler::sample(oAccess, xyz) <= 0.0f;
+    }
+    
+    void QueryPoints(   size_t nPoints,
+                        const Vector3* pvecPoints,
+                        bool* pbInside,         // can be nullptr
+                        float* pfSdValues,      // in mm, can be nullptr
+                        Vector3* pvecNormals,   // can be nullptr
+                        VoxelSize oVoxelSize) const
+    {
+        // Values and normals are trilinearly interpolated.
+        // The queries are sorted along a Z-order curve through the leaf
+        // nodes, so neighboring queries hit the same nodes, and every
+        // thread keeps its accessor (and node cache) for a range of them
         
-        int32_t iMaxSearchRadius = (int32_t) std::ceil(sqrt(
-                    oBBox.extents().x() * oBBox.extents().x() +
-                    oBBox.extents().y() * oBBox.extents().y() +
-                    oBBox.extents().z() * oBBox.extents().z()));
+        float fVoxelSizeMM = oVoxelSize;
         
-        bool bStartInside = oAccess.getValue(   
-                                openvdb::Coord( xyzSearch.X,
-                                                xyzSearch.Y,
-                                                xyzSearch.Z)) <= 0.0f;
+        std::vector<std::pair<uint64_t, size_t>> oOrder(nPoints);
         
-        for (int32_t iR=0; iR<iMaxSearchRadius; iR++)
+        tbb::parallel_for(  tbb::blocked_range<size_t>(0, nPoints),
+                            [&](const tbb::blocked_range<size_t>& oRange)
         {
-            bool bOutsideActiveBounds = true;
-            Coord xyzSurfacePoint;
-            
-            if (bBresenhamSphereHitTest(    bStartInside,
-                                            xyzSearch,
-                                            iR,
-                                            oAccess,
-                                            oBBox,
-                                            &xyzSurfacePoint,
-                                            &bOutsideActiveBounds))
+            for (size_t n=oRange.begin(); n<oRange.end(); n++)
             {
-                *pvecSurfacePoint = oVoxelSize.vecToMM(xyzSurfacePoint);
-                return true;
+                openvdb::Coord xyz = openvdb::Coord::floor(Vec3R(   pvecPoints[n].X / fVoxelSizeMM,
+                                                                    pvecPoints[n].Y / fVoxelSizeMM,
+                                                                    pvecPoints[n].Z / fVoxelSizeMM));
+                
+                oOrder[n] = {nMortonKey(xyz >> FloatLeaf::LOG2DIM), n};
             }
+        });
+        
+        tbb::parallel_sort(oOrder.begin(), oOrder.end());
+        
+        tbb::parallel_for(  tbb::blocked_range<size_t>(0, nPoints),
+                            [&](const tbb::blocked_range<size_t>& oRange)
+        {
+            auto oAccess = m_roGrid->getConstAccessor();
             
-            if (bOutsideActiveBounds)
-                return false;
-        }
+            for (size_t nSorted=oRange.begin(); nSorted<oRange.end(); nSorted++)
+            {
+                size_t n = oOrder[nSorted].second;
+                
+                Vec3R xyz(  pvecPoints[n].X / fVoxelSizeMM,
+                            pvecPoints[n].Y / fVoxelSizeMM,
+                            pvecPoints[n].Z / fVoxelSizeMM);
+                
+                float fValue = tools::BoxSampler::sample(oAccess, xyz);
+                
+                if (pbInside != nullptr)
+                    pbInside[n] = (fValue <= 0.0f);
+                
+                if (pfSdValues != nullptr)
+                    pfSdValues[n] = fValue * fVoxelSizeMM;
+                
+                if (pvecNormals != nullptr)
+                {
+                    Vec3R vecNormal = vecInterpolatedGradient(oAccess, xyz);
+                    vecNormal.normalize();
+                    
+                    pvecNormals[n] = Vector3(   (float) vecNormal.x(),
+                                                (float) vecNormal.y(),
+                                                (float) vecNormal.z());
+                }
+            }
+        });
+    }
+    
+    inline bool bFindClosestPointOnSurface( Vector3 vecSearch,
+                                            VoxelSize oVoxelSize,
+                                            Vector3* pvecSurfacePoint) const
+    {
+        std::vector<Vec3R> oPoints(1, Vec3R(    oVoxelSize.fToVoxels(vecSearch.X),
+                                                oVoxelSize.fToVoxels(vecSearch.Y),
+                                                oVoxelSize.fToVoxels(vecSearch.Z)));
+        
+        if (!bFindClosestPoints(oPoints))
+            return false;
+        
+        float fVoxelSizeMM = oVoxelSize;
         
-        return false;
+        *pvecSurfacePoint = Vector3(    (float) oPoints[0].x() * fVoxelSizeMM,
+                                        (float) oPoints[0].y() * fVoxelSizeMM,
+                                        (float) oPoints[0].z() * fVoxelSizeMM);
+        return true;
     }
     
     inline bool bRayCastToSurface(  const Vector3& vecSearch,
                                     const Vector3& vecDirection,
                                     VoxelSize oVoxelSize,
-                                    Vector3* pvecSurfacePoint)
+                                    Vector3* pvecSurfacePoint) const
     {
-        tools::LevelSetRayIntersector oIntersector(*m_roGrid);
-        math::Ray<Real> oRay(   Vec3f(  oVoxelSize.fToVoxels(vecSearch.X),
-                                        oVoxelSize.fToVoxels(vecSearch.Y),
-                                        oVoxelSize.fToVoxels(vecSearch.Z)),
-                                Vec3f(  vecDirection.X,
-                                        vecDirection.Y,
-                                        vecDirection.Z));
-        
-        math::Vec3<Real> xyz;
-        math::Vec3<Real> vecNormal;
+        int32_t nHits = 0;
+        
+        RayCastBatch(   1,
+                        &vecSearch,
+                        &vecDirection,
+                        1,
+                        &nHits,
+                        pvecSurfacePoint,
+                        nullptr,
+                        nullptr,
+                        oVoxelSize);
         
-        if (oIntersector.intersectsIS(oRay, xyz))
-        {
-            *pvecSurfacePoint = oVoxelSize.vecToMM( Coord(  xyz.x(),
-                                                            xyz.y(),
-                                                            xyz.z()));
-            return true;
-        }
-
         // If the ray reaches its maximum range without hitting a filled voxel,
         // return false to indicate that there was no intersection.
+        return nHits > 0;
+    }
+    
+    void RayCastBatch(  size_t nRays,
+                        const Vector3* pvecOrigins,
+                        const Vector3* pvecDirections,
+                        int32_t nMaxHitsPerRay,
+                        int32_t* pnHitCounts,
+                        Vector3* pvecHits,
+                        Vector3* pvecNormals,   // can be nullptr
+                        float* pfDistances,     // can be nullptr
+                        VoxelSize oVoxelSize) const
+    {
+        // Up to nMaxHitsPerRay surface crossings are returned for every ray,
+        // alternating between entering and exiting, at index
+        // nRay * nMaxHitsPerRay + nHit. After each hit, the ray continues
+        // from the first sample behind it which is on the other side of
+        // the surface.
+        // The intersector is expensive to build, so it's cached until the
+        // voxels change, every thread works with its own copy of it
+        
+        std::fill(pnHitCounts, pnHitCounts + nRays, 0);
+        
+        std::shared_ptr<RayIntersector> roPrototype = m_oRayIntersectorCache.roGet(
+                                                            m_nGeneration,
+                                                            [&]()
+        {
+            if (m_roGrid->empty())
+                return std::shared_ptr<RayIntersector>();
             
-        return false;
+            return std::make_shared<RayIntersector>(*m_roGrid);
+        });
+        
+        if ((roPrototype == nullptr) || (nMaxHitsPerRay < 1))
+            return;
+        
+        float fVoxelSizeMM = oVoxelSize;
+        
+        // steps to continue behind a hit, and how far to look, in voxels
+        const double fStep          = 0.05;
+        const double fMaxBehind     = 2.0;
+        
+        tbb::parallel_for(  tbb::blocked_range<size_t>(0, nRays),
+                            [&](const tbb::blocked_range<size_t>& oRange)
+        {
+            RayIntersector oIntersector(*roPrototype);
+            FloatGrid::ConstAccessor oAccess = m_roGrid->getConstAccessor();
+            
+            for (size_t n=oRange.begin(); n<oRange.end(); n++)
+            {
+                Vec3R vecDir(   pvecDirections[n].X,
+                                pvecDirections[n].Y,
+                                pvecDirections[n].Z);
+                
+                if (!vecDir.normalize())
+                    continue;
+                
+                Vec3R xyzStart( pvecOrigins[n].X / fVoxelSizeMM,
+                                pvecOrigins[n].Y / fVoxelSizeMM,
+                                pvecOrigins[n].Z / fVoxelSizeMM);
+                
+                double  fTravelled  = 0.0;
+                int32_t nHit        = 0;
+                
+                while (nHit < nMaxHitsPerRay)
+                {
+                    // identity transform, so world space is voxel space
+                    math::Ray<Real> oRay(xyzStart, vecDir);
+                    
+                    bool bInside = tools::BoxSampler::sample(oAccess, xyzStart) < 0.0f;
+                    
+                    Vec3R xyzHit;
+                    Vec3R vecNormal;
+                    Real  fTime;
+                    
+                    if (!oIntersector.intersectsWS(oRay, xyzHit, vecNormal, fTime))
+                        break;
+                    
+                    fTravelled += fTime;
+                    
+                    size_t nIndex = n * (size_t) nMaxHitsPerRay + (size_t) nHit;
+                    
+                    pvecHits[nIndex] = Vector3( (float) xyzHit.x() * fVoxelSizeMM,
+                                                (float) xyzHit.y() * fVoxelSizeMM,
+                                                (float) xyzHit.z() * fVoxelSizeMM);
+                    
+                    if (pvecNormals != nullptr)
+                    {
+                        vecNormal.normalize();
+                        pvecNormals[nIndex] = Vector3(  (float) vecNormal.x(),
+                                                        (float) vecNormal.y(),
+                                                        (float) vecNormal.z());
+                    }
+                    
+                    if (pfDistances != nullptr)
+                        pfDistances[nIndex] = (float) fTravelled * fVoxelSizeMM;
+                    
+                    nHit++;
+                    
+                    // The hit is interpolated between samples along the ray
+                    // and can lie short of the actual crossing, so step on
+                    // until the sign flips, or the same crossing would be
+                    // reported again as a zero thickness exit
+                    double fBehind = fStep;
+                    
+                    while ( (fBehind < fMaxBehind) &&
+                            ((tools::BoxSampler::sample(oAccess, xyzHit + vecDir * fBehind) < 0.0f) == bInside))
+                    {
+                        fBehind += fStep;
+                    }
+                    
+                    xyzStart    = xyzHit + vecDir * fBehind;
+                    fTravelled += fBehind;
+                }
+                
+                pnHitCounts[n] = nHit;
+            }
+        });
     }
     
     void GetVoxelDimensions(    int32_t* pnXMin,
@@ -576,7 +1386,7 @@ public:
                                 int32_t* pnYSize,
                                 int32_t* pnZSize) const
     {
-        CoordBBox oBBox = m_roGrid->evalActiveVoxelBoundingBox();
+        CoordBBox oBBox = oActiveBBox();
         
         *pnXMin     = oBBox.min().x();
         *pnYMin     = oBBox.min().y();
@@ -587,9 +1397,9 @@ public:
     }
     
     void GetSlice( int32_t nZSlice,
-                   float* pfBuffer)
+                   float* pfBuffer) const
     {
-        CoordBBox oBBox = m_roGrid->evalActiveVoxelBoundingBox();
+        CoordBBox oBBox = oActiveBBox();
         openvdb::Coord xyz(0, 0, nZSlice + oBBox.min().z());
         
         auto oAccess = m_roGrid->getConstAccessor();
@@ -604,9 +1414,9 @@ public:
     }
     
     void GetInterpolatedSlice(  float fZSlice,
-                                float* pfBuffer)
+                                float* pfBuffer) const
     {
-        CoordBBox oBBox = m_roGrid->evalActiveVoxelBoundingBox();
+        CoordBBox oBBox = oActiveBBox();
         
         auto oAccess = m_roGrid->getConstAccessor();
         
@@ -624,122 +1434,1069 @@ public:
     
     FloatGrid::Ptr roVdbGrid() const 	{return m_roGrid;}
     
+    CoordBBox oActiveBBox() const
+    {
+        return roStatistics()->oActiveBBox;
+    }
+    
+    void GetGridStatistics( int64_t* pnActiveVoxels,
+                            int64_t* pnLeafNodes,
+                            int64_t* pnMemoryBytes) const
+    {
+        std::shared_ptr<GridStatistics> roStats = roStatistics();
+        
+        *pnActiveVoxels = (int64_t) roStats->nActiveVoxels;
+        *pnLeafNodes    = (int64_t) roStats->nLeafNodes;
+        *pnMemoryBytes  = (int64_t) roStats->nMemoryBytes;
+    }
+    
     inline float fBackground() const    {return m_roGrid->background();}
     
     
 protected:
     FloatGrid::Ptr    m_roGrid;
     
-    template<class TAccessor, class TLatticeBeam>
-    static void DoRenderLattice(    TAccessor* poAccess,
-                                    float fBackground,
-                                    const TLatticeBeam& oLattice,
-                                    VoxelSize oVoxelSize)
+    // Derived data, like search structures, is cached until the voxels change.
+    // Every function that modifies the voxels calls Changed() before it touches
+    // the grid and only reads cached data (like the bbox) before that call
+    
+    inline void Changed()
+    {
+        m_nGeneration++;
+    }
+    
+    template <class T>
+    class Cached
     {
-        Vector3 vecMin(oLattice.vecMin());
-        Vector3 vecMax(oLattice.vecMax());
+    public:
+        Cached() {}
+        
+        // copies start out empty
+        Cached(const Cached&) {}
+        
+        Cached& operator=(const Cached&)
+        {
+            std::lock_guard<std::mutex> oLock(m_oMutex);
+            m_roValue.reset();
+            return *this;
+        }
+        
+        template <class TFnCreate>
+        std::shared_ptr<T> roGet(   uint64_t nGeneration,
+                                    const TFnCreate& fnCreate)
+        {
+            // created only once per generation, concurrent callers wait
+            std::lock_guard<std::mutex> oLock(m_oMutex);
+            
+            if ((m_roValue == nullptr) || (m_nGeneration != nGeneration))
+            {
+                m_roValue       = fnCreate();
+                m_nGeneration   = nGeneration;
+            }
+            
+            return m_roValue;
+        }
+        
+    protected:
+        std::mutex          m_oMutex;
+        std::shared_ptr<T>  m_roValue;
+        uint64_t            m_nGeneration = 0;
+    };
+    
+    std::atomic<uint64_t> m_nGeneration {0};
+    
+    class ClosestSurfaceSearch
+    {
+    public:
+        tools::ClosestSurfacePoint<FloatGrid>::Ptr  roSearch;
+        std::mutex                                  oMutex;
+    };
+    
+    mutable Cached<ClosestSurfaceSearch> m_oClosestSurfaceCache;
+    
+    class GridStatistics
+    {
+    public:
+        CoordBBox   oActiveBBox;
+        Index64     nActiveVoxels;
+        Index64     nLeafNodes;
+        Index64     nMemoryBytes;
+    };
+    
+    mutable Cached<GridStatistics> m_oStatisticsCache;
+    
+    std::shared_ptr<GridStatistics> roStatistics() const
+    {
+        return m_oStatisticsCache.roGet(    m_nGeneration,
+                                            [&]()
+        {
+            std::shared_ptr<GridStatistics> roStats = std::make_shared<GridStatistics>();
             
-        Coord xyzMin = oVoxelSize.xyzToVoxels(vecMin);
-        Coord xyzMax = oVoxelSize.xyzToVoxels(vecMax);
+            const FloatTree& oTree = m_roGrid->tree();
+            
+            roStats->oActiveBBox    = m_roGrid->evalActiveVoxelBoundingBox();
+            roStats->nActiveVoxels  = oTree.activeVoxelCount();
+            roStats->nLeafNodes     = oTree.leafCount();
+            roStats->nMemoryBytes   = oTree.memUsage();
+            return roStats;
+        });
+    }
+    
+    typedef tools::LevelSetRayIntersector<FloatGrid> RayIntersector;
+    
+    mutable Cached<RayIntersector> m_oRayIntersectorCache;
+    
+    typedef FloatTree::LeafNodeType FloatLeaf;
+    typedef FloatTree::RootNodeType::ChildNodeType::ChildNodeType FloatLowerNode;
+    
+    CoordBBox oPaddedVoxelBBox( const BBox3& oBBox,
+                                VoxelSize oVoxelSize) const
+    {
+        Coord xyzMin = oVoxelSize.xyzToVoxels(oBBox.vecMin);
+        Coord xyzMax = oVoxelSize.xyzToVoxels(oBBox.vecMax);
         
         // Increase the bounding box by the voxel distance of the background value
         // so we don't cut off the narrow band
-        int32_t iAdd = (int32_t) (fBackground + 0.5f);
+        int32_t iAdd = (int32_t) (m_roGrid->background() + 0.5f);
         
-        for(int32_t x = xyzMin.X - iAdd; x <= xyzMax.X + iAdd; x++)
-        for(int32_t y = xyzMin.Y - iAdd; y <= xyzMax.Y + iAdd; y++)
-        for(int32_t z = xyzMin.Z - iAdd; z <= xyzMax.Z + iAdd; z++)
+        return CoordBBox(   openvdb::Coord( xyzMin.X - iAdd,
+                                            xyzMin.Y - iAdd,
+                                            xyzMin.Z - iAdd),
+                            openvdb::Coord( xyzMax.X + iAdd,
+                                            xyzMax.Y + iAdd,
+                                            xyzMax.Z + iAdd));
+    }
+    
+    void OffsetVx(float fSizeVx)
+    {
+        // Positive sizes grow the surface outwards
+        //
+        // The level set filter advects the band in steps of about one voxel,
+        // which is fine for small offsets, but its cost grows with the
+        // distance. Larger offsets extract the surface at the shifted
+        // isovalue and rebuild the band around it in one pass. If the new
+        // surface lies outside the narrow band, the band is first extended
+        // by fast sweeping, on the side we are moving into only
+        
+        float fAbsVx = std::abs(fSizeVx);
+        
+        if (fAbsVx == 0.0f)
+            return;
+        
+        if (fAbsVx <= 1.0f)
         {
-            openvdb::Coord xyz(x,y,z);
+            openvdb::tools::LevelSetFilter<openvdb::FloatGrid> oFilter(*m_roGrid);
+            oFilter.offset(-fSizeVx); // openvdb treats offsets as inwards
+            return;
+        }
+        
+        float fBack = fBackground();
+        FloatGrid::Ptr roSource = m_roGrid;
+        
+        if (fAbsVx > fBack - 1.0f)
+        {
+            int nDilation = (int) std::ceil(fAbsVx - fBack) + 2;
             
-            Vector3 vecSample = oVoxelSize.vecToMM(Coord(x,y,z));
+            roSource = openvdb::tools::dilateSdf(   *m_roGrid,
+                                                    nDilation,
+                                                    openvdb::tools::NN_FACE_EDGE_VERTEX,
+                                                    1,
+                                                    (fSizeVx > 0) ?
+                                                        openvdb::tools::FastSweepingDomain::SWEEP_GREATER_THAN_ISOVALUE :
+                                                        openvdb::tools::FastSweepingDomain::SWEEP_LESS_THAN_ISOVALUE);
+        }
+        
+        // Only the tree is replaced, so the grid keeps its metadata,
+        // which metadata handles refer to
+        FloatGrid::Ptr roRebuilt = openvdb::tools::levelSetRebuild(*roSource, fSizeVx, fBack, fBack);
+        m_roGrid->setTree(roRebuilt->treePtr());
+    }
+    
+    void OffsetSequenceVx(std::initializer_list<float> afStagesVx)
+    {
+        // Runs several offsets in a row, positive sizes grow the surface
+        //
+        // Instead of rebuilding the band after each stage, the band is
+        // widened once to cover the whole excursion of the surface. Each
+        // intermediate stage then works in place on that one tree: the
+        // active values are shifted by the stage, and the band is
+        // redistanced by normalization, which keeps the topology. Only
+        // the last stage rebuilds a narrow band around the final surface
+        
+        float fCurrent      = 0.0f;
+        float fExcursion    = 0.0f;
+        float fLargest      = 0.0f;
+        
+        for (float fStage : afStagesVx)
+        {
+            fCurrent    += fStage;
+            fExcursion  = std::max(fExcursion, std::abs(fCurrent));
+            fLargest    = std::max(fLargest, std::abs(fStage));
+        }
+        
+        if ((afStagesVx.size() < 2) || (fLargest <= 1.0f))
+        {
+            for (float fStage : afStagesVx)
+                OffsetVx(fStage);
             
-            // Boolean add to existing value, if one exists
-            float fValue = std::min(    oVoxelSize.fToVoxels(oLattice.fSdValue(vecSample)),
-                                        poAccess->getValue(xyz));
+            return;
+        }
+        
+        float fBack = fBackground();
+        int nDilation = (int) std::ceil(std::max(fExcursion, fLargest)) + 2;
+        
+        FloatGrid::Ptr roWide = openvdb::tools::dilateSdf(  *m_roGrid,
+                                                            nDilation,
+                                                            openvdb::tools::NN_FACE_EDGE_VERTEX);
+        roWide->setGridClass(GRID_LEVEL_SET);
+        
+        openvdb::tools::LevelSetTracker<openvdb::FloatGrid> oTracker(*roWide);
+        oTracker.setTrimming(openvdb::tools::lstrack::TrimMode::kNone);
+        
+        const float* pfLast = afStagesVx.end() - 1;
+        
+        for (const float* pfStage = afStagesVx.begin(); pfStage != pfLast; pfStage++)
+        {
+            float fStage = *pfStage;
+            std::atomic<bool> bInside(false);
             
-            SetSdValue(poAccess, xyz, fBackground, fValue);
+            tree::LeafManager<FloatTree> oLeafs(roWide->tree());
+            oLeafs.foreach([fStage, &bInside](FloatLeaf& oLeaf, size_t)
+            {
+                bool bLeafInside = false;
+                
+                for (auto iter = oLeaf.beginValueOn(); iter; ++iter)
+                {
+                    float fValue = *iter - fStage;
+                    iter.setValue(fValue);
+                    bLeafInside |= (fValue <= 0.0f);
+                }
+                
+                if (bLeafInside)
+                    bInside = true;
+            });
+            
+            if (!bInside)
+            {
+                // No surface left after this stage, everything was eroded
+                m_roGrid->clear();
+                return;
+            }
+            
+            // Each normalization step moves information by about half
+            // a voxel, so the band is corrected as far as the stage moved
+            oTracker.setNormCount((int) std::ceil(2.0f * std::abs(fStage)) + 2);
+            oTracker.normalize();
         }
+        
+        FloatGrid::Ptr roRebuilt = openvdb::tools::levelSetRebuild(*roWide, *pfLast, fBack, fBack);
+        m_roGrid->setTree(roRebuilt->treePtr()); // keeps the grid and its metadata
     }
     
-    static FloatGrid::Ptr roFloatGridFromMesh(  const Mesh& oMesh,
-                                                float fVoxelSizeMM,
-                                                float fBackground)
+    void FilterRegion(  EFilter eFilter,
+                        float fSizeVx,
+                        const CoordBBox& oRegion,
+                        const FloatGrid& oAlpha)
     {
-        std::vector< openvdb::Vec3s >   oVertices;
-        std::vector< openvdb::Vec3I >   oTriangles;
+        // Only the part of the grid around the region is copied out and
+        // filtered, so the cost scales with the region, not the grid.
+        // The margin covers the filter stencil, the distance the surface
+        // moves and the band, so that leaves inside the region never see
+        // the clipped border of the part
+        
+        if (oRegion.empty())
+            return;
+        
+        float fBack = fBackground();
+        
+        CoordBBox oPart = oRegion;
+        oPart.expand((int32_t) std::ceil(std::abs(fSizeVx) + fBack) + (int32_t) FloatLeaf::DIM);
+        
+        FloatGrid::Ptr roPart = FloatGrid::create(fBack);
+        roPart->setTransform(m_roGrid->transform().copy());
+        roPart->setGridClass(GRID_LEVEL_SET);
+        
+        CopyLeaves(*m_roGrid, *roPart, oPart);
+        
+        openvdb::tools::LevelSetFilter<openvdb::FloatGrid> oFilter(*roPart);
         
-        for (int32_t n=0; n<oMesh.nVertexCount(); n++)
+        switch (eFilter)
         {
-            Vector3 v(0.0f,0.0f,0.0f);
-            oMesh.GetVertex(n, (Vector3*)&v);
-            oVertices.push_back(openvdb::Vec3s( v.X,
-                                                v.Y,
-                                                v.Z));
+            case eFilterOffset:
+                oFilter.offset(-fSizeVx, &oAlpha); // openvdb treats offsets as inwards
+                break;
+                
+            case eFilterGaussian:
+                oFilter.gaussian((int) std::abs(fSizeVx), &oAlpha);
+                break;
+                
+            case eFilterMedian:
+                oFilter.median((int) std::abs(fSizeVx), &oAlpha);
+                break;
+                
+            case eFilterMean:
+                oFilter.mean((int) std::abs(fSizeVx), &oAlpha);
+                break;
         }
         
-        for (int32_t n=0; n<oMesh.nTriangleCount(); n++)
+        CopyLeaves(*roPart, *m_roGrid, oRegion);
+    }
+    
+    static void CopyLeaves( const FloatGrid& oSource,
+                            FloatGrid& oTarget,
+                            const CoordBBox& oBBox)
+    {
+        // Replaces the content of oTarget inside the bounding box, rounded
+        // out to whole leaves, with the content of oSource. Only the nodes
+        // the source actually has there are visited. Leaves are copied and
+        // inserted one at a time, tiles are filled, clipped to the box, so
+        // nothing is densified and memory follows the narrow band
+        
+        if (oBBox.empty())
+            return;
+        
+        typedef FloatTree::RootNodeType::ChildNodeType FloatUpperNode;
+        
+        int32_t iMask = ~((int32_t) FloatLeaf::DIM - 1);
+        CoordBBox oAligned( oBBox.min() & iMask,
+                            (oBBox.max() & iMask).offsetBy((int32_t) FloatLeaf::DIM - 1));
+        
+        float fBack = oSource.background();
+        FloatTree& oTargetTree = oTarget.tree();
+        
+        if (!oTargetTree.empty())
+            oTargetTree.fill(oAligned, oTarget.background(), false);
+        
+        auto FillTile = [&](const openvdb::Coord& xyzOrigin,
+                            int32_t iDim,
+                            float fValue,
+                            bool bActive)
+        {
+            if (!bActive && (fValue == fBack))
+                return; // already cleared
+            
+            CoordBBox oTile = CoordBBox::createCube(xyzOrigin, iDim);
+            oTile.intersect(oAligned);
+            
+            if (!oTile.empty())
+                oTargetTree.fill(oTile, fValue, bActive);
+        };
+        
+        const FloatTree::RootNodeType& oRoot = oSource.tree().root();
+        
+        for (auto iter = oRoot.cbeginValueAll(); iter; ++iter)
+            FillTile(iter.getCoord(), (int32_t) FloatUpperNode::DIM, *iter, iter.isValueOn());
+        
+        for (auto iterUpper = oRoot.cbeginChildOn(); iterUpper; ++iterUpper)
         {
-            Triangle t;
-            oMesh.GetTriangle(n, &t);
-            oTriangles.push_back(openvdb::Vec3I(    (unsigned int) t.A,
-                                                    (unsigned int) t.B,
-                                                    (unsigned int) t.C));
+            if (!oAligned.hasOverlap(iterUpper->getNodeBoundingBox()))
+                continue;
+            
+            for (auto iter = iterUpper->cbeginValueAll(); iter; ++iter)
+                FillTile(iter.getCoord(), (int32_t) FloatLowerNode::DIM, *iter, iter.isValueOn());
+            
+            for (auto iterLower = iterUpper->cbeginChildOn(); iterLower; ++iterLower)
+            {
+                if (!oAligned.hasOverlap(iterLower->getNodeBoundingBox()))
+                    continue;
+                
+                for (auto iter = iterLower->cbeginValueAll(); iter; ++iter)
+                    FillTile(iter.getCoord(), (int32_t) FloatLeaf::DIM, *iter, iter.isValueOn());
+                
+                for (auto iterLeaf = iterLower->cbeginChildOn(); iterLeaf; ++iterLeaf)
+                {
+                    if (oAligned.isInside(iterLeaf->origin()))
+                        oTargetTree.addLeaf(new FloatLeaf(*iterLeaf)); // tree takes ownership
+                }
+            }
         }
-
-        openvdb::math::Transform::Ptr roTransform
-            = openvdb::math::Transform::createLinearTransform(fVoxelSizeMM);
-
-        return openvdb::tools::meshToLevelSet<openvdb::FloatGrid>(  *roTransform,
-                                                                    oVertices,
-                                                                    oTriangles,
-                                                                    fBackground);
     }
     
-    template <class TAccessor>
-    inline bool bBresenhamSphereHitTest(    bool bReferenceInside,
-                                            Coord xyzCenter,
-                                            int iRadius,
-                                            const TAccessor& oAccess,
-                                            const openvdb::CoordBBox& oBB,
-                                            Coord* pxyzPoint,
-                                            bool* pbOutsideActiveBounds)
+    void ProjectZColumns(   const CoordBBox& oBBox,
+                            int32_t iZStart,
+                            int32_t iZEnd,
+                            int32_t iDir)
     {
-        *pbOutsideActiveBounds = true;
+        // Projects the minimum value from iZStart to iZEnd, in direction
+        // iDir (+1 or -1), and closes the band beyond iZEnd by averaging
+        // every voxel with the next one.
+        // Each leaf-aligned (x,y) column block is swept by one thread,
+        // keeping a running minimum per column, leaf by leaf. The grid is
+        // only read while sweeping, the leaves that changed are swapped
+        // into the tree at the end
+        
+        if (oBBox.empty())
+            return;
+        
+        float   fBack   = fBackground();
+        int32_t iBand   = (int32_t) (0.5f + fBack);
+        int32_t iDim    = (int32_t) FloatLeaf::DIM;
+        
+        // Sweep position s, 0 at iZStart, sEnd at iZEnd
+        int32_t sEnd    = (iZEnd - iZStart) * iDir;
+        int32_t sLast   = sEnd + iBand - 1;
+        
+        // Before reaching the active voxels everything is background,
+        // which doesn't change the minimum, so we can start there
+        int32_t iZActive = (iDir < 0) ? oBBox.max().z() : oBBox.min().z();
+        int32_t sFirst   = std::clamp((iZActive - iZStart) * iDir, 0, std::max(sEnd, 0));
+        
+        if (sLast < sFirst)
+            return;
+        
+        int32_t iZFirst = iZStart + sFirst * iDir;
+        int32_t iZLast  = iZStart + sLast * iDir;
+        
+        // leaf origins along Z, in sweep order
+        std::vector<int32_t> oLeafZ;
+        for (   int32_t iLeafZ = iZFirst & ~(iDim - 1);
+                (iLeafZ - (iZLast & ~(iDim - 1))) * iDir <= 0;
+                iLeafZ += iDim * iDir)
+        {
+            oLeafZ.push_back(iLeafZ);
+        }
         
-        openvdb::Coord xyz;
+        std::vector<openvdb::Coord> oColumns = oAlignedOrigins(     CoordBBox(  openvdb::Coord(oBBox.min().x(), oBBox.min().y(), 0),
+                                                                                openvdb::Coord(oBBox.max().x(), oBBox.max().y(), 0)),
+                                                                    iDim);
         
-        for (xyz.z() = xyzCenter.Z - iRadius; xyz.z() <= xyzCenter.Z + iRadius; xyz.z()++)
+        tbb::enumerable_thread_specific<std::vector<FloatLeaf*>> oThreadLeafs;
+        
+        tbb::parallel_for(  tbb::blocked_range<size_t>(0, oColumns.size()),
+                            [&](const tbb::blocked_range<size_t>& oRange)
         {
-            int r2 = iRadius * iRadius;
-            for (xyz.y() = xyzCenter.Y - iRadius; xyz.y() <= xyzCenter.Y + iRadius; xyz.y()++)
+            auto oAccess = m_roGrid->getConstAccessor();
+            std::vector<FloatLeaf*>& oLeafs = oThreadLeafs.local();
+            
+            float afMin[FloatLeaf::DIM * FloatLeaf::DIM];
+            
+            for (size_t nColumn=oRange.begin(); nColumn<oRange.end(); nColumn++)
             {
-                for (xyz.x() = xyzCenter.X - iRadius; xyz.x() <= xyzCenter.X + iRadius; xyz.x()++)
+                std::fill(std::begin(afMin), std::end(afMin), std::numeric_limits<float>::max());
+                
+                for (int32_t iLeafZ : oLeafZ)
                 {
-                    if (!oBB.isInside(xyz))
-                        continue; // don't search outside active voxel area
+                    openvdb::Coord xyzOrigin(   oColumns[nColumn].x(),
+                                                oColumns[nColumn].y(),
+                                                iLeafZ);
                     
-                    *pbOutsideActiveBounds = false; // we are still inside the bounds
+                    FloatLeaf* poLeaf = poLeafCopy(oAccess, xyzOrigin);
+                    bool bChanged = false;
                     
-                    int dx = xyz.x() - xyzCenter.X;
-                    int dy = xyz.y() - xyzCenter.Y;
-                    int dz = xyz.z() - xyzCenter.Z;
-                    if (dx * dx + dy * dy + dz * dz <= r2)
+                    for (int32_t i=0; i<iDim; i++)
                     {
-                        bool bInside = oAccess.getValue(xyz) <= 0.0f;
-                        if (bInside != bReferenceInside)
+                        int32_t iZ  = (iDir > 0) ? i : (iDim - 1 - i);
+                        int32_t z   = iLeafZ + iZ;
+                        int32_t s   = (z - iZStart) * iDir;
+                        
+                        if ((s < sFirst) || (s > sLast))
+                            continue;
+                        
+                        for (int32_t x=0; x<iDim; x++)
+                        for (int32_t y=0; y<iDim; y++)
                         {
-                            pxyzPoint->X = xyz.x();
-                            pxyzPoint->Y = xyz.y();
-                            pxyzPoint->Z = xyz.z();
-                            return true;
+                            Index nOffset   = FloatLeaf::coordToOffset(openvdb::Coord(x, y, iZ));
+                            float fOld      = poLeaf->getValue(nOffset);
+                            bool  bOldOn    = poLeaf->isValueOn(nOffset);
+                            float& fMin     = afMin[x * iDim + y];
+                            
+                            if (s <= sEnd)
+                                fMin = std::min(fMin, fOld);
+                            
+                            float fNew;
+                            
+                            if (s >= sEnd)
+                            {
+                                // closing the band, the next voxel has not
+                                // been written yet
+                                float fNext = ((iZ + iDir >= 0) && (iZ + iDir < iDim)) ?
+                                                poLeaf->getValue(FloatLeaf::coordToOffset(openvdb::Coord(x, y, iZ + iDir))) :
+                                                oAccess.getValue(openvdb::Coord(xyzOrigin.x() + x,
+                                                                                xyzOrigin.y() + y,
+                                                                                z + iDir));
+                                
+                                float fProjected = (s == sEnd) ? fMin : fOld;
+                                fNew = (fProjected + fNext) / 2.0f;
+                            }
+                            else if (s > 0)
+                            {
+                                fNew = fMin;
+                            }
+                            else
+                            {
+                                continue; // start slice stays as it is
+                            }
+                            
+                            SetSdValue(poLeaf, nOffset, fBack, fNew);
+                            
+                            if ((poLeaf->getValue(nOffset) != fOld) ||
+                                (poLeaf->isValueOn(nOffset) != bOldOn))
+                            {
+                                bChanged = true;
+                            }
                         }
                     }
+                    
+                    if (bChanged)
+                        oLeafs.push_back(poLeaf);
+                    else
+                        delete poLeaf;
+                }
+            }
+        });
+        
+        for (std::vector<FloatLeaf*>& oLeafs : oThreadLeafs)
+        {
+            for (FloatLeaf* poLeaf : oLeafs)
+                m_roGrid->tree().addLeaf(poLeaf); // tree takes ownership
+        }
+    }
+    
+    bool bFindClosestPoints(std::vector<Vec3R>& oPoints) const
+    {
+        // Replaces the points (in voxel coordinates) by the closest points
+        // on the surface.
+        // Inside the narrow band we project onto the surface along the
+        // interpolated gradient. Further away the values are clamped, so we
+        // first jump to the closest surface sample, found with a search
+        // structure that is cached until the voxels change
+        
+        float fBand = fBackground() - 1.0f;
+        
+        std::vector<size_t> oFar;
+        {
+            auto oAccess = m_roGrid->getConstAccessor();
+            
+            for (size_t n=0; n<oPoints.size(); n++)
+            {
+                if (std::abs(tools::BoxSampler::sample(oAccess, oPoints[n])) >= fBand)
+                    oFar.push_back(n);
+            }
+        }
+        
+        if (!oFar.empty())
+        {
+            std::shared_ptr<ClosestSurfaceSearch> roCache = m_oClosestSurfaceCache.roGet(
+                                                                m_nGeneration,
+                                                                [&]()
+            {
+                std::shared_ptr<ClosestSurfaceSearch> roNew = std::make_shared<ClosestSurfaceSearch>();
+                roNew->roSearch = tools::ClosestSurfacePoint<FloatGrid>::create(*m_roGrid);
+                return roNew;
+            });
+            
+            if (roCache->roSearch == nullptr)
+                return false; // no surface
+            
+            std::vector<Vec3R> oFarPoints;
+            for (size_t n : oFar)
+                oFarPoints.push_back(oPoints[n]);
+            
+            std::vector<float> oDistances;
+            
+            {
+                std::lock_guard<std::mutex> oLock(roCache->oMutex);
+                if (!roCache->roSearch->searchAndReplace(oFarPoints, oDistances))
+                    return false;
+            }
+            
+            for (size_t n=0; n<oFar.size(); n++)
+                oPoints[oFar[n]] = oFarPoints[n];
+        }
+        
+        tbb::parallel_for(  tbb::blocked_range<size_t>(0, oPoints.size()),
+                            [&](const tbb::blocked_range<size_t>& oRange)
+        {
+            auto oAccess = m_roGrid->getConstAccessor();
+            
+            for (size_t n=oRange.begin(); n<oRange.end(); n++)
+                oPoints[n] = xyzProjectToSurface(oAccess, oPoints[n]);
+        });
+        
+        return true;
+    }
+    
+    static uint64_t nMortonKey(const openvdb::Coord& xyz)
+    {
+        // interleaves the lower 21 bits of each coordinate,
+        // offset, so negative coordinates sort correctly
+        
+        auto nSpread = [](uint64_t n)
+        {
+            n &= 0x1fffff;
+            n = (n | (n << 32)) & 0x1f00000000ffffULL;
+            n = (n | (n << 16)) & 0x1f0000ff0000ffULL;
+            n = (n | (n << 8))  & 0x100f00f00f00f00fULL;
+            n = (n | (n << 4))  & 0x10c30c30c30c30c3ULL;
+            n = (n | (n << 2))  & 0x1249249249249249ULL;
+            return n;
+        };
+        
+        const int64_t iOffset = 1 << 20;
+        
+        return  (nSpread((uint64_t) (xyz.x() + iOffset)) << 2) |
+                (nSpread((uint64_t) (xyz.y() + iOffset)) << 1) |
+                 nSpread((uint64_t) (xyz.z() + iOffset));
+    }
+    
+    template <class TAccessor>
+    static Vec3R vecInterpolatedGradient(   const TAccessor& oAccess,
+                                            const Vec3R& xyz)
+    {
+        // central differences of the trilinear interpolation, half a voxel apart
+        const double h = 0.5;
+        
+        return Vec3R(   tools::BoxSampler::sample(oAccess, xyz + Vec3R(h, 0, 0)) -
+                        tools::BoxSampler::sample(oAccess, xyz - Vec3R(h, 0, 0)),
+                        tools::BoxSampler::sample(oAccess, xyz + Vec3R(0, h, 0)) -
+                        tools::BoxSampler::sample(oAccess, xyz - Vec3R(0, h, 0)),
+                        tools::BoxSampler::sample(oAccess, xyz + Vec3R(0, 0, h)) -
+                        tools::BoxSampler::sample(oAccess, xyz - Vec3R(0, 0, h))) / (2.0 * h);
+    }
+    
+    template <class TAccessor>
+    static Vec3R xyzProjectToSurface(   const TAccessor& oAccess,
+                                        Vec3R xyz)
+    {
+        // Newton steps along the gradient, the values are distances,
+        // so this converges in very few iterations
+        
+        for (int n=0; n<8; n++)
+        {
+            double fValue = tools::BoxSampler::sample(oAccess, xyz);
+            
+            if (std::abs(fValue) < 1e-4)
+                break;
+            
+            Vec3R vecGrad   = vecInterpolatedGradient(oAccess, xyz);
+            double fLength2 = vecGrad.lengthSqr();
+            
+            if (fLength2 < 1e-12)
+                break;
+            
+            xyz -= vecGrad * (fValue / fLength2);
+        }
+        
+        return xyz;
+    }
+    
+    static FloatLeaf::NodeMaskType oInsideMask(const FloatLeaf& oLeaf)
+    {
+        FloatLeaf::NodeMaskType oMask;
+        
+        const float* pfValues = oLeaf.buffer().data();
+        for (Index nOffset=0; nOffset<FloatLeaf::SIZE; nOffset++)
+        {
+            if (pfValues[nOffset] <= 0.0f)
+                oMask.setOn(nOffset);
+        }
+        
+        return oMask;
+    }
+    
+    class Moments
+    {
+    public:
+        // Volume, area, first and second moments in voxel units,
+        // second moments are xx, yy, zz, xy, xz, yz
+        
+        void AddVoxel(  const openvdb::Coord& xyz,
+                        double fWeight)
+        {
+            double x = xyz.x();
+            double y = xyz.y();
+            double z = xyz.z();
+            
+            // a voxel is a unit cube, so it adds 1/12 about its own center
+            fVolume         += fWeight;
+            afFirst[0]      += fWeight * x;
+            afFirst[1]      += fWeight * y;
+            afFirst[2]      += fWeight * z;
+            afSecond[0]     += fWeight * (x * x + 1.0 / 12.0);
+            afSecond[1]     += fWeight * (y * y + 1.0 / 12.0);
+            afSecond[2]     += fWeight * (z * z + 1.0 / 12.0);
+            afSecond[3]     += fWeight * x * y;
+            afSecond[4]     += fWeight * x * z;
+            afSecond[5]     += fWeight * y * z;
+        }
+        
+        void AddBox(    const CoordBBox& oBox,
+                        double fWeight)
+        {
+            // closed form sums over all voxels of the box
+            double afS0[3];
+            double afS1[3];
+            double afS2[3];
+            
+            for (int n=0; n<3; n++)
+            {
+                double a = oBox.min()[n];
+                double b = oBox.max()[n];
+                
+                afS0[n] = b - a + 1.0;
+                afS1[n] = (a + b) * afS0[n] * 0.5;
+                afS2[n] = fSumOfSquares(b) - fSumOfSquares(a - 1.0) + afS0[n] / 12.0;
+            }
+            
+            fVolume         += fWeight * afS0[0] * afS0[1] * afS0[2];
+            afFirst[0]      += fWeight * afS1[0] * afS0[1] * afS0[2];
+            afFirst[1]      += fWeight * afS0[0] * afS1[1] * afS0[2];
+            afFirst[2]      += fWeight * afS0[0] * afS0[1] * afS1[2];
+            afSecond[0]     += fWeight * afS2[0] * afS0[1] * afS0[2];
+            afSecond[1]     += fWeight * afS0[0] * afS2[1] * afS0[2];
+            afSecond[2]     += fWeight * afS0[0] * afS0[1] * afS2[2];
+            afSecond[3]     += fWeight * afS1[0] * afS1[1] * afS0[2];
+            afSecond[4]     += fWeight * afS1[0] * afS0[1] * afS1[2];
+            afSecond[5]     += fWeight * afS0[0] * afS1[1] * afS1[2];
+        }
+        
+        void Add(const Moments& oOther)
+        {
+            fVolume += oOther.fVolume;
+            fArea   += oOther.fArea;
+            
+            for (int n=0; n<3; n++)
+                afFirst[n] += oOther.afFirst[n];
+            
+            for (int n=0; n<6; n++)
+                afSecond[n] += oOther.afSecond[n];
+            
+            oInside.expand(oOther.oInside);
+        }
+        
+        double      fVolume     = 0.0;
+        double      fArea       = 0.0;
+        double      afFirst[3]  = {0.0, 0.0, 0.0};
+        double      afSecond[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+        CoordBBox   oInside;    // voxels <= 0
+        
+    protected:
+        static double fSumOfSquares(double n)
+        {
+            // 1^2 + 2^2 + ... + n^2, also valid for negative n
+            return n * (n + 1.0) * (2.0 * n + 1.0) / 6.0;
+        }
+    };
+    
+    Moments oCalculateMoments() const
+    {
+        // One parallel pass over all leaf voxels, using a smeared Heaviside
+        // function for the volume and the matching smeared delta function
+        // times the gradient magnitude for the area, both over a band of
+        // +/- fEps voxels, which gives sub-voxel accuracy. Interior tiles
+        // are added as whole boxes afterwards
+        
+        const double fEps = 1.5;
+        const double fPi  = 3.14159265358979323846;
+        
+        tree::LeafManager<const FloatTree> oLeafs(m_roGrid->tree());
+        
+        Moments oMom = tbb::parallel_reduce(
+                        tbb::blocked_range<size_t>(0, oLeafs.leafCount()),
+                        Moments(),
+                        [&](const tbb::blocked_range<size_t>& oRange, Moments oPartial)
+        {
+            auto oAccess = m_roGrid->getConstAccessor();
+            
+            for (size_t n=oRange.begin(); n<oRange.end(); n++)
+            {
+                for (auto iter = oLeafs.leaf(n).cbeginValueAll(); iter; ++iter)
+                {
+                    double fPhi = *iter;
+                    
+                    if (fPhi >= fEps)
+                        continue; // outside, contributes nothing
+                    
+                    openvdb::Coord xyz = iter.getCoord();
+                    
+                    if (fPhi <= 0.0)
+                        oPartial.oInside.expand(xyz);
+                    
+                    if (fPhi <= -fEps)
+                    {
+                        oPartial.AddVoxel(xyz, 1.0);
+                        continue;
+                    }
+                    
+                    double fHeaviside = 0.5 * (1.0 - fPhi / fEps - std::sin(fPi * fPhi / fEps) / fPi);
+                    oPartial.AddVoxel(xyz, fHeaviside);
+                    
+                    double fDelta = (1.0 + std::cos(fPi * fPhi / fEps)) / (2.0 * fEps);
+                    
+                    double fGradX = oAccess.getValue(xyz.offsetBy(1, 0, 0)) - oAccess.getValue(xyz.offsetBy(-1, 0, 0));
+                    double fGradY = oAccess.getValue(xyz.offsetBy(0, 1, 0)) - oAccess.getValue(xyz.offsetBy(0, -1, 0));
+                    double fGradZ = oAccess.getValue(xyz.offsetBy(0, 0, 1)) - oAccess.getValue(xyz.offsetBy(0, 0, -1));
+                    
+                    oPartial.fArea += fDelta * 0.5 * std::sqrt(fGradX * fGradX + fGradY * fGradY + fGradZ * fGradZ);
+                }
+            }
+            
+            return oPartial;
+        },
+                        [](Moments oA, const Moments& oB)
+        {
+            oA.Add(oB);
+            return oA;
+        });
+        
+        FloatTree::ValueAllCIter iter = m_roGrid->tree().cbeginValueAll();
+        iter.setMaxDepth(FloatTree::ValueAllCIter::LEAF_DEPTH - 1); // tiles only
+        
+        for (; iter; ++iter)
+        {
+            if (*iter > 0.0f)
+                continue;
+            
+            CoordBBox oTile;
+            iter.getBoundingBox(oTile);
+            
+            oMom.AddBox(oTile, 1.0);
+            oMom.oInside.expand(oTile);
+        }
+        
+        return oMom;
+    }
+    
+    static Voxels::Ptr roUnionOf(   const std::vector<const Voxels*>& oOperands,
+                                    size_t nBegin,
+                                    size_t nEnd)
+    {
+        // Pairwise union of the operands in [nBegin, nEnd), both halves
+        // are computed in parallel, so the depth is log N. Only the pairs
+        // at the bottom copy from the operands, everything above merges
+        // the intermediate results by stealing their nodes. Each operand
+        // is copied exactly once
+        
+        if (nEnd - nBegin == 1)
+            return std::make_shared<Voxels>(*oOperands[nBegin]);
+        
+        if (nEnd - nBegin == 2)
+        {
+            Voxels::Ptr roResult = std::make_shared<Voxels>(*oOperands[nBegin]);
+            roResult->BoolAdd(*oOperands[nBegin + 1]);
+            return roResult;
+        }
+        
+        size_t nMid = nBegin + (nEnd - nBegin) / 2;
+        
+        Voxels::Ptr roA;
+        Voxels::Ptr roB;
+        
+        tbb::parallel_invoke(   [&]{roA = roUnionOf(oOperands, nBegin, nMid);},
+                                [&]{roB = roUnionOf(oOperands, nMid, nEnd);});
+        
+        roA->BoolAddConsume(*roB);
+        return roA;
+    }
+    
+    template <class TMergeOp>
+    void MergeCopyOnDemand(const Voxels& oOther)
+    {
+        // Same as the openvdb::tools::csg functions, but the operand
+        // is only read, and just the nodes which end up in the result
+        // are copied, instead of deep-copying the whole operand first
+        
+        TMergeOp oMerge(oOther.m_roGrid->constTree(), openvdb::tools::DeepCopy());
+        
+        openvdb::tree::DynamicNodeManager<FloatTree> oNodes(m_roGrid->tree());
+        oNodes.foreachTopDown(oMerge);
+        
+        openvdb::tools::pruneLevelSet(m_roGrid->tree());
+    }
+    
+    static std::vector<openvdb::Coord> oLeafOrigins(const CoordBBox& oBBox)
+    {
+        return oAlignedOrigins(oBBox, (int32_t) FloatLeaf::DIM);
+    }
+    
+    static size_t nLeafCount(const CoordBBox& oBBox)
+    {
+        // Number of leaf nodes overlapping the bounding box
+        
+        if (oBBox.empty())
+            return 0;
+        
+        int32_t iMask = ~((int32_t) FloatLeaf::DIM - 1);
+        openvdb::Coord xyzMin = oBBox.min() & iMask;
+        openvdb::Coord xyzMax = oBBox.max() & iMask;
+        
+        size_t nCount = 1;
+        for (int n=0; n<3; n++)
+            nCount *= (size_t) ((xyzMax[n] - xyzMin[n]) / (int32_t) FloatLeaf::DIM + 1);
+        
+        return nCount;
+    }
+    
+    static std::vector<openvdb::Coord> oAlignedOrigins( const CoordBBox& oBBox,
+                                                        int32_t iDim)
+    {
+        // Origins of all iDim^3 blocks overlapping the bounding box
+        // iDim has to be a power of two
+        
+        std::vector<openvdb::Coord> oOrigins;
+        
+        if (oBBox.empty())
+            return oOrigins;
+        
+        openvdb::Coord xyzMin = oBBox.min() & ~(iDim - 1);
+        
+        for (int32_t x = xyzMin.x(); x <= oBBox.max().x(); x += iDim)
+        for (int32_t y = xyzMin.y(); y <= oBBox.max().y(); y += iDim)
+        for (int32_t z = xyzMin.z(); z <= oBBox.max().z(); z += iDim)
+        {
+            oOrigins.push_back(openvdb::Coord(x,y,z));
+        }
+        
+        return oOrigins;
+    }
+    
+    static FloatLeaf* poLeafCopy(   FloatGrid::ConstAccessor& oAccess,
+                                    const openvdb::Coord& xyzOrigin)
+    {
+        // Returns a detached copy of the leaf at the specified origin,
+        // or a new leaf filled with the tile value, if there is no leaf
+        
+        const FloatLeaf* poExisting = oAccess.probeConstLeaf(xyzOrigin);
+        
+        if (poExisting != nullptr)
+            return new FloatLeaf(*poExisting);
+        
+        return new FloatLeaf(   xyzOrigin,
+                                oAccess.getValue(xyzOrigin),
+                                oAccess.isValueOn(xyzOrigin));
+    }
+    
+    template <class TFnSdf>
+    void RenderLeavesParallel(  const std::vector<openvdb::Coord>& oOrigins,
+                                const CoordBBox& oClip,
+                                const TFnSdf& fnSdf)
+    {
+        // fnSdf(nLeafIndex, xyz) returns the signed distance in voxels,
+        // voxels outside of oClip are left untouched
+        
+        RenderLeafValuesParallel(   oOrigins,
+                                    [&](size_t nLeaf, const openvdb::Coord& xyzOrigin, float* pfValues)
+        {
+            for (Index nOffset=0; nOffset<FloatLeaf::SIZE; nOffset++)
+            {
+                openvdb::Coord xyz = xyzOrigin + FloatLeaf::offsetToLocalCoord(nOffset);
+                
+                pfValues[nOffset] = oClip.isInside(xyz) ?   fnSdf(nLeaf, xyz) :
+                                                            std::numeric_limits<float>::max();
+            }
+        });
+    }
+    
+    template <class TFnLeaf>
+    void RenderLeafValuesParallel(  const std::vector<openvdb::Coord>& oOrigins,
+                                    const TFnLeaf& fnLeaf)
+    {
+        // Every leaf is computed into a private copy by one thread only.
+        // fnLeaf(nLeafIndex, xyzOrigin, pfValues) fills the signed distance
+        // in voxels for all voxels of the leaf, in leaf offset order, with
+        // float max for voxels it doesn't touch. The grid is only read while
+        // the threads are running, and the finished leaves are swapped into
+        // the tree at the end
+        
+        float fBack = fBackground();
+        tbb::enumerable_thread_specific<std::vector<FloatLeaf*>> oThreadLeafs;
+        
+        tbb::parallel_for(  tbb::blocked_range<size_t>(0, oOrigins.size()),
+                            [&](const tbb::blocked_range<size_t>& oRange)
+        {
+            auto oAccess = m_roGrid->getConstAccessor();
+            std::vector<FloatLeaf*>& oLeafs = oThreadLeafs.local();
+            
+            float afValues[FloatLeaf::SIZE];
+            
+            for (size_t n=oRange.begin(); n<oRange.end(); n++)
+            {
+                FloatLeaf* poLeaf = poLeafCopy(oAccess, oOrigins[n]);
+                
+                fnLeaf(n, oOrigins[n], afValues);
+                
+                for (Index nOffset=0; nOffset<FloatLeaf::SIZE; nOffset++)
+                {
+                    if (afValues[nOffset] == std::numeric_limits<float>::max())
+                        continue;
+                    
+                    float fValue = std::min(    afValues[nOffset],
+                                                poLeaf->getValue(nOffset));
+                    
+                    SetSdValue(poLeaf, nOffset, fBack, fValue);
                 }
+                
+                oLeafs.push_back(poLeaf);
             }
+        });
+        
+        for (std::vector<FloatLeaf*>& oLeafs : oThreadLeafs)
+        {
+            for (FloatLeaf* poLeaf : oLeafs)
+                m_roGrid->tree().addLeaf(poLeaf); // tree takes ownership
         }
+    }
+    
+    class MeshAdapter
+    {
+    public:
+        // Lets openvdb read the triangles directly from the mesh buffers,
+        // converting the vertices from mm to voxel coordinates on the fly
+        
+        MeshAdapter(    const Mesh& oMesh,
+                        VoxelSize oVoxelSize)
+        {
+            m_pvecVertices  = (const Vector3*) oMesh.pVertexData();
+            m_psTriangles   = (const Triangle*) oMesh.pTriangleData();
+            m_nVertices     = (size_t) oMesh.nVertexCount();
+            m_nTriangles    = (size_t) oMesh.nTriangleCount();
+            m_dVoxelSizeMM  = (float) oVoxelSize;
+        }
+        
+        size_t polygonCount() const         {return m_nTriangles;}
+        size_t pointCount() const           {return m_nVertices;}
+        size_t vertexCount(size_t) const    {return 3;}
+        
+        void getIndexSpacePoint(    size_t nTriangle,
+                                    size_t nCorner,
+                                    openvdb::Vec3d& vecPoint) const
+        {
+            const Triangle& sTri = m_psTriangles[nTriangle];
+            
+            int32_t nVertex =   (nCorner == 0) ? sTri.A :
+                                (nCorner == 1) ? sTri.B : sTri.C;
+            
+            const Vector3& vec = m_pvecVertices[nVertex];
+            
+            vecPoint = openvdb::Vec3d(  vec.X / m_dVoxelSizeMM,
+                                        vec.Y / m_dVoxelSizeMM,
+                                        vec.Z / m_dVoxelSizeMM);
+        }
+        
+    protected:
+        const Vector3*  m_pvecVertices;
+        const Triangle* m_psTriangles;
+        size_t          m_nVertices;
+        size_t          m_nTriangles;
+        double          m_dVoxelSizeMM;
+    };
+    
+    static FloatGrid::Ptr roFloatGridFromMesh(  const Mesh& oMesh,
+                                                VoxelSize oVoxelSize,
+                                                float fBackground)
+    {
+        // The voxels use an index space transform, so the adapter
+        // scales the mesh into voxel coordinates, no copies are made
+        
+        MeshAdapter oAdapter(oMesh, oVoxelSize);
         
-        return false;
+        openvdb::math::Transform::Ptr roTransform
+            = openvdb::math::Transform::createLinearTransform(1.0);
+        
+        return openvdb::tools::meshToVolume<openvdb::FloatGrid>(    oAdapter,
+                                                                    *roTransform,
+                                                                    fBackground,
+                                                                    fBackground);
     }
     
     static void SetSdValue( FloatGrid::Accessor* poAccess,
@@ -755,6 +2512,21 @@ protected:
             poAccess->setValueOff(xyz);
     }
     
+    static void SetSdValue( FloatLeaf* poLeaf,
+                            Index nOffset,
+                            float fBackground,
+                            float fValue)
+    {
+        float fClamped = std::clamp(    fValue,
+                                        -fBackground,
+                                        fBackground);
+        
+        if (std::abs(fValue) >= fBackground)
+            poLeaf->setValueOff(nOffset, fClamped);
+        else
+            poLeaf->setValueOn(nOffset, fClamped);
+    }
+    
 };
 
 } // PicoGK namespace